@@ -6,59 +6,278 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
 
 #include "dlutil.h"
 #include "dlalloc.h"
+#include "dlnuma.h"
 
-/* there must be a better way than this! */
-class dlvideobuf;
-static dlvideobuf *heap[POOLSIZE];
-static unsigned spare;
+#define HUGEPAGESIZE (2*1024*1024)
+#define PAGESIZE 4096
 
 ULONG STDMETHODCALLTYPE dlvideobuf::AddRef()
 {
     //dlmessage("videobuf %2d addref: refcnt=%d", index, refcnt+1);
-    return ++refcnt;
+    return __atomic_add_fetch(&refcnt, 1, __ATOMIC_ACQ_REL);
 }
 
 ULONG STDMETHODCALLTYPE dlvideobuf::Release()
 {
-    ULONG ret = --refcnt;
+    ULONG ret = __atomic_sub_fetch(&refcnt, 1, __ATOMIC_ACQ_REL);
     //dlmessage("videobuf %2d release: refcnt=%d", index, refcnt);
     if (!ret) {
-        /* put buffer on spare heap */
-        heap[spare++] = this;
+        /* put buffer on free list of its pool */
+        owner->recycle(this);
     }
     return ret;
 }
 
+/* pool of video buffers of one size class */
+dlvideopool::dlvideopool(dlalloc *a, int32_t r, int32_t h, pixelformat_t p)
+{
+    alloc = a;
+    rowbytes = r;
+    height = h;
+    pixelformat = p;
+    bufsize = (size_t)rowbytes*height;
+    bytes = 0;
+    count = 0;
+    preallocated = 0;
+    lastused = 0;
+    memset(pool, 0, sizeof(dlvideobuf *) * POOLSIZE);
+
+    region = NULL;
+    region_size = 0;
+    hugetlb = false;
+
+    /* init free list */
+    memset(next, 0, sizeof(unsigned) * POOLSIZE);
+    freelist = 0;
+    num_idle = 0;
+}
+
+dlvideopool::~dlvideopool()
+{
+    for (unsigned i=0; i<count; i++)
+        delete pool[i];
+
+    if (region)
+        munmap(region, region_size);
+}
+
+int dlvideopool::preallocate(unsigned num, bool lock, int node)
+{
+    /* the pool can only be preallocated before any buffer is allocated */
+    if (num==0 || count>0)
+        return 0;
+    if (num>POOLSIZE)
+        num = POOLSIZE;
+
+    /* allocate all buffers in a single mapping, first try explicit huge pages */
+    size_t stride = (bufsize + PAGESIZE-1) & ~(size_t)(PAGESIZE-1);
+    size_t length = (stride*num + HUGEPAGESIZE-1) & ~(size_t)(HUGEPAGESIZE-1);
+    unsigned char *base = (unsigned char *)mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (base!=MAP_FAILED) {
+        region = base;
+        region_size = length;
+        hugetlb = true;
+    } else {
+        /* else map normal pages aligned for transparent huge pages */
+        unsigned char *ptr = (unsigned char *)mmap(NULL, length+HUGEPAGESIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (ptr==MAP_FAILED) {
+            dlmessage("warning: failed to preallocate %d video buffers: %s", num, strerror(errno));
+            return 0;
+        }
+        region = ptr;
+        region_size = length+HUGEPAGESIZE;
+        base = (unsigned char *)(((uintptr_t)ptr + HUGEPAGESIZE-1) & ~(uintptr_t)(HUGEPAGESIZE-1));
+        madvise(base, length, MADV_HUGEPAGE);
+    }
+
+    /* place the pages on the node of the card */
+    if (node>=0 && bind_memory_to_node(base, length, node)<0)
+        dlmessage("warning: failed to bind video buffers to numa node %d", node);
+
+    /* prefault every page */
+    for (size_t offset=0; offset<length; offset+=PAGESIZE)
+        ((volatile unsigned char *)base)[offset] = 0;
+
+    /* keep the buffers resident */
+    if (lock && mlock(base, length)!=0)
+        dlmessage("warning: failed to lock video buffers in memory: %s", strerror(errno));
+
+    /* fill the free list */
+    for (unsigned i=0; i<num; i++) {
+        pool[i] = new dlvideobuf(base + i*stride, i, this, true);
+        recycle(pool[i]);
+    }
+    count = preallocated = num;
+    bytes = length;
+    return num;
+}
+
+dlvideobuf *dlvideopool::grow()
+{
+    if (count==POOLSIZE)
+        return NULL;
+
+    void *buf;
+    if (posix_memalign(&buf, 1024, bufsize) != 0)
+        return NULL;
+    pool[count] = new dlvideobuf(buf, count, this);
+    bytes += bufsize;
+
+    return pool[count++];
+}
+
+void dlvideopool::recycle(dlvideobuf *buffer)
+{
+    unsigned i = buffer->index;
+    dlalloc *a = alloc;
+
+    /* push the buffer onto the free list */
+    unsigned long long top = __atomic_load_n(&freelist, __ATOMIC_RELAXED);
+    while (1) {
+        __atomic_store_n(&next[i], (unsigned)top, __ATOMIC_RELAXED);
+        unsigned long long update = ((top>>32)+1)<<32 | (i+1);
+        if (__atomic_compare_exchange_n(&freelist, &top, update, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            break;
+        __atomic_add_fetch(&a->num_contended, 1, __ATOMIC_RELAXED);
+    }
+
+    /* once the last buffer is idle the pool may be retired by the allocating thread,
+     * so this is the last access to the pool */
+    __atomic_add_fetch(&num_idle, 1, __ATOMIC_RELEASE);
+
+    /* wake an allocation waiting for a buffer */
+    if (__atomic_load_n(&a->waiters, __ATOMIC_SEQ_CST))
+        a->wake();
+}
+
+dlvideobuf *dlvideopool::pop()
+{
+    /* pop a buffer from the free list, the tag in the upper
+     * half of the list head guards against a stale next index */
+    unsigned long long top = __atomic_load_n(&freelist, __ATOMIC_ACQUIRE);
+    while (1) {
+        unsigned i = (unsigned)top;
+        if (i==0)
+            return NULL;
+        unsigned long long update = ((top>>32)+1)<<32 | __atomic_load_n(&next[i-1], __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&freelist, &top, update, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            __atomic_sub_fetch(&num_idle, 1, __ATOMIC_RELEASE);
+            return pool[i-1];
+        }
+        __atomic_add_fetch(&alloc->num_contended, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* custom memory allocator, buffers are allocated from the pool of the current
+ * size class on one thread, but may be released on any thread */
 dlalloc::dlalloc()
 {
     refcnt = 1;
-    bufsize = 0;
+    node = -1;
+    budget = 0;
 
-    /* init pool */
-    index = 0;
-    spare = 0;
-    memset(pool, 0, sizeof(dlvideobuf *) * POOLSIZE);
-    memset(heap, 0, sizeof(dlvideobuf *) * POOLSIZE);
+    /* init pools */
+    memset(pools, 0, sizeof(dlvideopool *) * MAX_POOLS);
+    current = NULL;
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+    waiters = 0;
+
+    num_reused = num_allocated = num_contended = num_blocked = 0;
 }
 
 dlalloc::~dlalloc()
 {
-    unsigned i;
+    for (int i=0; i<MAX_POOLS; i++)
+        if (pools[i])
+            delete pools[i];
+
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+void dlalloc::init(int32_t rowbytes, int32_t height, pixelformat_t pixelformat, unsigned preallocate, bool lock)
+{
+    /* find the pool of this size class, previous pools are kept for when the format changes back */
+    current = NULL;
+    int slot = -1;
+    for (int i=0; i<MAX_POOLS; i++) {
+        if (pools[i] && pools[i]->matches(rowbytes, height, pixelformat))
+            current = pools[i];
+        else if (!pools[i] && slot<0)
+            slot = i;
+    }
+
+    /* else create a new pool */
+    if (!current) {
+        if (slot<0)
+            slot = retire_oldest();
+        if (slot<0)
+            dlexit("error: too many sizes of video buffer in use");
+        pools[slot] = current = new dlvideopool(this, rowbytes, height, pixelformat);
+    }
+    current->lastused = get_utime();
+
+    /* preallocate within the memory budget */
+    if (preallocate && current->count==0) {
+        if (budget) {
+            size_t needed = preallocate*current->bufsize;
+            retire(needed);
+            if (bytes()+needed>budget) {
+                preallocate = (budget-mmin(bytes(), budget))/current->bufsize;
+                dlmessage("warning: memory budget limits preallocation to %d video buffers", preallocate);
+            }
+        }
+        current->preallocate(preallocate, lock, node);
+    }
+}
+
+size_t dlalloc::bytes()
+{
+    size_t total = 0;
+    for (int i=0; i<MAX_POOLS; i++)
+        if (pools[i])
+            total += pools[i]->bytes;
+    return total;
+}
+
+/* free the least recently used pool which has all of its buffers released, returns its slot */
+int dlalloc::retire_oldest()
+{
+    int oldest = -1;
+    for (int i=0; i<MAX_POOLS; i++)
+        if (pools[i] && pools[i]!=current && pools[i]->idle()==pools[i]->count)
+            if (oldest<0 || pools[i]->lastused<pools[oldest]->lastused)
+                oldest = i;
 
-    for (i=0; i<index; i++)
-        if (pool[i])
-            delete pool[i];
+    if (oldest>=0) {
+        delete pools[oldest];
+        pools[oldest] = NULL;
+    }
+    return oldest;
+}
 
-    index = 0;
-    memset(pool, 0, sizeof(void *) * POOLSIZE);
+/* shrink the other pools until there is room in the budget, returns true if there is */
+bool dlalloc::retire(size_t needed)
+{
+    while (bytes()+needed>budget)
+        if (retire_oldest()<0)
+            return false;
+    return true;
 }
 
-void dlalloc::init(uint32_t bufferSize)
+void dlalloc::wake()
 {
-    bufsize = bufferSize;
+    pthread_mutex_lock(&mutex);
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
 }
 
 ULONG STDMETHODCALLTYPE dlalloc::AddRef()
@@ -75,28 +294,50 @@ HRESULT dlalloc::AllocateVideoBuffer(IDeckLinkVideoBuffer ** allocated)
 {
     if (!allocated)
         return E_POINTER;
-    if (bufsize==0)
+    if (!current)
         return E_UNEXPECTED;
 
     /* first try to reuse a spare buffer */
-    if (spare>0) {
-        *allocated = heap[--spare];
+    dlvideobuf *buffer = current->pop();
+    if (buffer) {
+        __atomic_add_fetch(&num_reused, 1, __ATOMIC_RELAXED);
+        *allocated = buffer;
         return S_OK;
     }
 
-    /* else allocate a new buffer */
-    if (index==POOLSIZE) {
-        dlmessage("all buffers in pool of size %d are allocated", POOLSIZE);
-        return E_OUTOFMEMORY;
+    /* else grow the pool, within the memory budget */
+    if (!budget || retire(current->bufsize))
+        buffer = current->grow();
+    if (buffer) {
+        __atomic_add_fetch(&num_allocated, 1, __ATOMIC_RELAXED);
+        *allocated = buffer;
+        return S_OK;
     }
 
-    void *buf;
-    if (posix_memalign(&buf, 1024, bufsize) != 0)
-        return E_OUTOFMEMORY;
-    pool[index] = new dlvideobuf(buf, index);
+    /* else apply backpressure, waiting until a buffer is released */
+    __atomic_add_fetch(&num_blocked, 1, __ATOMIC_RELAXED);
+    unsigned long long start = get_utime();
+    int warned = 0;
+    pthread_mutex_lock(&mutex);
+    __atomic_add_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+    while ((buffer = current->pop())==NULL) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 100000000;
+        if (ts.tv_nsec>=1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&cond, &mutex, &ts);
 
-    *allocated = pool[index];
-    index++;
+        /* complain if the wait is long */
+        if ((get_utime()-start)/1000000>(unsigned)warned)
+            dlmessage("warning: waited %ds for a video buffer to be released, %zuMB in use", ++warned, bytes()>>20);
+    }
+    __atomic_sub_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&mutex);
 
+    __atomic_add_fetch(&num_reused, 1, __ATOMIC_RELAXED);
+    *allocated = buffer;
     return S_OK;
 }
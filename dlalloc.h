@@ -1,7 +1,13 @@
 #ifndef DLALLOC_H
 #define DLALLOC_H
 
+#include <pthread.h>
+
 #define POOLSIZE 256
+#define MAX_POOLS 8
+
+class dlalloc;
+class dlvideopool;
 
 /* custom video buffer for dltools */
 class dlvideobuf : public IDeckLinkVideoBuffer
@@ -10,11 +16,14 @@ private:
     unsigned refcnt;
     void *buf;
     unsigned index;
+    dlvideopool *owner;
+    bool mapped;
+
+    friend class dlvideopool;
 
 public:
-    dlvideobuf(void *ptr) : refcnt(0), buf(ptr) {}
-    dlvideobuf(void *ptr, unsigned index) : refcnt(0), buf(ptr), index(index) {}
-    ~dlvideobuf() {free(buf);}
+    dlvideobuf(void *ptr, unsigned index, dlvideopool *owner, bool mapped=false) : refcnt(0), buf(ptr), index(index), owner(owner), mapped(mapped) {}
+    ~dlvideobuf() {if (!mapped) free(buf);}
 
     /* implementation of IUnknown */
     virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, LPVOID *ppv) {return E_NOINTERFACE;}
@@ -27,6 +36,54 @@ public:
     virtual HRESULT EndAccess(BMDBufferAccessFlags flags) {return S_OK;}
 };
 
+/* pool of video buffers of one size class, keyed by row bytes, height and pixel format */
+class dlvideopool
+{
+public:
+    dlvideopool(dlalloc *alloc, int32_t rowbytes, int32_t height, pixelformat_t pixelformat);
+    ~dlvideopool();
+
+    bool matches(int32_t r, int32_t h, pixelformat_t p) { return r==rowbytes && h==height && p==pixelformat; }
+
+    /* allocate all buffers up front, prefaulted and backed by huge pages */
+    int preallocate(unsigned num, bool lock, int node);
+
+    /* allocate a new buffer, or NULL if the pool is full */
+    dlvideobuf *grow();
+
+    /* the free list of released buffers, safe to use from any thread */
+    void recycle(dlvideobuf *buffer);
+    dlvideobuf *pop();
+
+    /* pool metadata */
+    size_t bufsize;
+    size_t bytes;           /* memory held by the pool */
+    unsigned count;         /* number of buffers in the pool */
+    unsigned preallocated;  /* number of those which were preallocated */
+    unsigned idle() { return __atomic_load_n(&num_idle, __ATOMIC_ACQUIRE); }
+    unsigned long long lastused;
+    const char *backing() { return hugetlb? "huge pages" : "transparent huge pages"; }
+    void *first() { return count? pool[0]->buf : NULL; }
+
+private:
+    dlalloc *alloc;
+    int32_t rowbytes;
+    int32_t height;
+    pixelformat_t pixelformat;
+    dlvideobuf *pool[POOLSIZE];
+
+    /* single mapping of preallocated buffers */
+    void *region;
+    size_t region_size;
+    bool hugetlb;
+
+    /* free list of released buffers, a lock-free stack linked by pool index,
+     * the head holds a modification tag and the pool index plus one of the top */
+    unsigned next[POOLSIZE];
+    unsigned long long freelist __attribute__((aligned(64)));
+    unsigned num_idle;
+};
+
 /* custom memory allocator for dltools */
 class dlalloc : public IDeckLinkVideoBufferAllocator
 {
@@ -35,7 +92,25 @@ public:
     ~dlalloc();
 
     /* implementation */
-    void init(uint32_t bufferSize);
+    /* select the size class of subsequent buffers, optionally preallocating
+     * a pool of prefaulted buffers backed by huge pages */
+    void init(int32_t rowbytes, int32_t height, pixelformat_t pixelformat, unsigned preallocate=0, bool lock=false);
+
+    /* numa node for preallocated buffers, -1 for no binding */
+    void set_node(int n) { node = n; }
+
+    /* limit on memory held by all pools, 0 for no limit */
+    void set_budget(size_t bytes) { budget = bytes; }
+
+    /* statistics */
+    unsigned preallocated() { return current? current->preallocated : 0; }
+    const char *backing() { return current? current->backing() : ""; }
+    void *first() { return current? current->first() : NULL; }
+    size_t bytes();
+    unsigned long long reused() { return __atomic_load_n(&num_reused, __ATOMIC_RELAXED); }
+    unsigned long long allocated() { return __atomic_load_n(&num_allocated, __ATOMIC_RELAXED); }
+    unsigned long long contended() { return __atomic_load_n(&num_contended, __ATOMIC_RELAXED); }
+    unsigned long long blocked() { return __atomic_load_n(&num_blocked, __ATOMIC_RELAXED); }
 
     /* implementation of IUnknown */
     virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, LPVOID *ppv) {return E_NOINTERFACE;}
@@ -47,10 +122,30 @@ public:
     //virtual HRESULT STDMETHODCALLTYPE ReleaseVideoBuffer(void *buf);
 
 private:
+    friend class dlvideopool;
+
+    bool retire(size_t needed);
+    int retire_oldest();
+    void wake();
+
     unsigned refcnt;
-    uint32_t bufsize;
-    dlvideobuf *pool[POOLSIZE];
-    unsigned index;
+    int node;
+    size_t budget;
+
+    /* size classes */
+    dlvideopool *pools[MAX_POOLS];
+    dlvideopool *current;
+
+    /* an allocation blocks while the pool is exhausted, until a buffer is released */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned waiters;
+
+    /* counters of reused buffers, fresh allocations, failed compare and swaps and blocked allocations */
+    unsigned long long num_reused __attribute__((aligned(64)));
+    unsigned long long num_allocated;
+    unsigned long long num_contended;
+    unsigned long long num_blocked;
 };
 
 #endif // DLALLOC_H
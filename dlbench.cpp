@@ -0,0 +1,492 @@
+/*
+ * Description: benchmark conversion and demux throughput without a DeckLink card.
+ * Author     : Ryan Dalzell
+ * Copyright  : (c) 2026 4i2i Communications Ltd.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <x86intrin.h>
+
+#include "dlutil.h"
+#include "dlconv.h"
+#include "dlkernel.h"
+#include "dlpool.h"
+#include "dlsource.h"
+#include "dlformat.h"
+#include "dlts.h"
+
+const char *appname = "dlbench";
+
+/* instruction sets in order of preference */
+static const char *isas[] = { "avx512", "avx2", "ssse3", "sse2", "c" };
+
+/* standard rasters */
+static const struct {
+    int width;
+    int height;
+} rasters[] = {
+    {  720,  486 },
+    {  720,  576 },
+    { 1280,  720 },
+    { 1920, 1080 },
+    { 3840, 2160 },
+};
+
+/* conversions used by dlplay */
+static const struct {
+    pixelformat_t src;
+    pixelformat_t dst;
+} conversions[] = {
+    { I420, UYVY },
+    { I422, UYVY },
+    { I444, UYVY },
+    { YU15, V210 },
+    { YU20, V210 },
+    { P010, V210 },
+    { P210, V210 },
+};
+
+/* synthetic transport stream */
+#define TS_PMT_PID      0x100
+#define TS_VIDEO_PID    0x101
+#define TS_AUDIO_PID    0x102
+#define TS_PES_SIZE     (64*1024)
+
+/* results of one benchmark run */
+typedef struct {
+    unsigned long long usecs;
+    unsigned long long cycles;
+} timing_t;
+
+static bool json = false;
+static bool first_result = true;
+
+void usage(int exitcode)
+{
+    fprintf(stderr, "%s: benchmark conversion and demux throughput\n", appname);
+    fprintf(stderr, "usage: %s [options]\n", appname);
+    fprintf(stderr, "  -n, --numframes     : number of frames per conversion (default: 30)\n");
+    fprintf(stderr, "  -k, --isa           : only benchmark the kernels for this instruction set (avx512, avx2, ssse3, sse2, c)\n");
+    fprintf(stderr, "  -j, --threads       : number of threads for conversion (default: 1)\n");
+    fprintf(stderr, "  -s, --size          : size of synthetic transport stream in Mbytes (default: 64)\n");
+    fprintf(stderr, "  -C, --no-convert    : skip conversion benchmarks\n");
+    fprintf(stderr, "  -D, --no-demux      : skip demux benchmarks\n");
+    fprintf(stderr, "  -J, --json          : print results as json\n");
+    fprintf(stderr, "  -q, --quiet         : decrease verbosity, can be used multiple times\n");
+    fprintf(stderr, "  -v, --verbose       : increase verbosity, can be used multiple times\n");
+    fprintf(stderr, "  --                  : disable argument processing\n");
+    fprintf(stderr, "  -u, --help, --usage : print this usage message\n");
+    exit(exitcode);
+}
+
+static unsigned char *alloc_buffer(size_t size)
+{
+    void *buf = NULL;
+    if (posix_memalign(&buf, 64, size))
+        dlexit("failed to allocate buffer of %zu bytes", size);
+    return (unsigned char *)buf;
+}
+
+/* print one result, either as a table row or as a json object */
+static void print_result(const char *test, const char *name, const char *stores, int width, int height, unsigned frames, size_t bytes, timing_t t)
+{
+    const double secs = t.usecs/1000000.0;
+    const double mbps = bytes/(double)t.usecs;
+    const double fps = frames/secs;
+
+    if (json) {
+        printf("%s    { \"test\": \"%s\", \"name\": \"%s\"", first_result? "" : ",\n", test, name);
+        if (stores)
+            printf(", \"stores\": \"%s\", \"width\": %d, \"height\": %d", stores, width, height);
+        printf(", \"frames\": %u, \"bytes\": %zu, \"usecs\": %llu, \"mbytes_per_sec\": %.1f, \"frames_per_sec\": %.1f", frames, bytes, t.usecs, mbps, fps);
+        if (stores)
+            printf(", \"cycles_per_pixel\": %.3f", t.cycles/((double)frames*width*height));
+        else
+            printf(", \"cycles_per_byte\": %.3f", t.cycles/(double)bytes);
+        printf(" }");
+    } else {
+        if (stores)
+            printf("%-8s %-16s %-9s %4dx%-4d %8.1f MB/s %8.1f fps %7.3f cycles/pixel\n", test, name, stores, width, height, mbps, fps, t.cycles/((double)frames*width*height));
+        else
+            printf("%-8s %-16s %-9s %9s %8.1f MB/s %8.1f pes/s %7.3f cycles/byte\n", test, name, "", "", mbps, fps, t.cycles/(double)bytes);
+    }
+    fflush(stdout);
+    first_result = false;
+}
+
+/* fill a source picture with random samples of its bitdepth */
+static void fill_picture(unsigned char *buf, size_t size, pixelformat_t pixelformat)
+{
+    if (pixelformat_is_8bit(pixelformat))
+        for (size_t i=0; i<size; i++)
+            buf[i] = rand();
+    else
+        for (size_t i=0; i<size/2; i++)
+            ((uint16_t *)buf)[i] = rand() & 0x3ff;
+}
+
+static timing_t time_conversion(const picture_t *src, const picture_t *dst, int numframes)
+{
+    /* warm up the caches and the worker pool */
+    convert_yuv_uyvy(src, dst);
+
+    timing_t t;
+    unsigned long long start = get_utime();
+    unsigned long long cycles = __rdtsc();
+    for (int i=0; i<numframes; i++)
+        convert_yuv_uyvy(src, dst);
+    t.cycles = __rdtsc() - cycles;
+    t.usecs = get_utime() - start;
+    if (t.usecs==0)
+        t.usecs = 1;
+
+    return t;
+}
+
+static void bench_convert(const char *onlyisa, int numframes)
+{
+    for (unsigned r=0; r<sizeof(rasters)/sizeof(rasters[0]); r++) {
+        const int width = rasters[r].width;
+        const int height = rasters[r].height;
+
+        for (unsigned c=0; c<sizeof(conversions)/sizeof(conversions[0]); c++) {
+            const pixelformat_t srcformat = conversions[c].src;
+            const pixelformat_t dstformat = conversions[c].dst;
+
+            /* allocate and describe the pictures */
+            const size_t srcsize = pixelformat_get_size(srcformat, width, height);
+            const size_t dstsize = pixelformat_get_size(dstformat, width, height);
+            unsigned char *srcbuf = alloc_buffer(srcsize);
+            unsigned char *dstbuf = alloc_buffer(dstsize);
+            fill_picture(srcbuf, srcsize, srcformat);
+            memset(dstbuf, 0, dstsize);
+            picture_t src, dst;
+            picture_init(&src, srcbuf, width, height, srcformat);
+            picture_init(&dst, dstbuf, width, height, dstformat);
+
+            for (int nontemporal=0; nontemporal<2; nontemporal++) {
+                dst.nontemporal = nontemporal;
+
+#ifdef HAVE_LIBYUV
+                /* libyuv does its own dispatch, so time it only once */
+                const bool libyuv = !nontemporal && (srcformat==I420 || srcformat==I422);
+#else
+                const bool libyuv = false;
+#endif
+
+                for (unsigned i=0; i<sizeof(isas)/sizeof(isas[0]); i++) {
+                    if (onlyisa && strcmp(onlyisa, isas[i])!=0)
+                        continue;
+                    if (convert_set_isa(isas[i])<0)
+                        continue;
+
+                    char name[32];
+                    snprintf(name, sizeof(name), "%s-%s-%s", pixelformatname[srcformat], pixelformatname[dstformat], libyuv? "libyuv" : isas[i]);
+                    timing_t t = time_conversion(&src, &dst, numframes);
+                    print_result("convert", name, nontemporal? "streaming" : "cached", width, height, numframes, (srcsize+dstsize)*numframes, t);
+
+                    if (libyuv)
+                        break;
+                }
+            }
+
+            free(srcbuf);
+            free(dstbuf);
+        }
+    }
+
+    /* restore the default kernels */
+    convert_set_isa(NULL);
+}
+
+/* write a single packet psi section */
+static void write_section(FILE *file, int pid, int *cc, const unsigned char *section, int length)
+{
+    unsigned char packet[188];
+    memset(packet, 0xff, sizeof(packet));
+    packet[0] = 0x47;
+    packet[1] = 0x40 | (pid >> 8);
+    packet[2] = pid & 0xff;
+    packet[3] = 0x10 | (*cc & 0xf);
+    packet[4] = 0;  /* pointer_field */
+    memcpy(packet+5, section, length);
+    uint32_t crc = crc32_mpeg2(section, length);
+    packet[5+length+0] = crc >> 24;
+    packet[5+length+1] = crc >> 16;
+    packet[5+length+2] = crc >> 8;
+    packet[5+length+3] = crc;
+    *cc = *cc + 1;
+
+    if (fwrite(packet, 188, 1, file)!=1)
+        dlerror("failed to write synthetic transport stream");
+}
+
+/* write one pes packet with a pts, split into transport packets */
+static void write_pes(FILE *file, int pid, int *cc, int stream_id, long long pts, const unsigned char *payload, size_t size)
+{
+    unsigned char pes[14+TS_PES_SIZE];
+    pes[0] = 0x00;
+    pes[1] = 0x00;
+    pes[2] = 0x01;
+    pes[3] = stream_id;
+    size_t length = size+8 > 0xffff? 0 : size+8;
+    pes[4] = length >> 8;
+    pes[5] = length & 0xff;
+    pes[6] = 0x80;
+    pes[7] = 0x80;  /* pts only */
+    pes[8] = 5;
+    pes[9] = 0x21 | ((pts >> 29) & 0x0e);
+    pes[10] = pts >> 22;
+    pes[11] = 0x01 | ((pts >> 14) & 0xfe);
+    pes[12] = pts >> 7;
+    pes[13] = 0x01 | ((pts << 1) & 0xfe);
+    memcpy(pes+14, payload, size);
+    size += 14;
+
+    /* packetise, stuffing the last packet with an adaptation field */
+    for (size_t offset=0; offset<size; ) {
+        unsigned char packet[188];
+        size_t bytes = mmin(size-offset, (size_t)184);
+        packet[0] = 0x47;
+        packet[1] = (offset==0? 0x40 : 0x00) | (pid >> 8);
+        packet[2] = pid & 0xff;
+        packet[3] = (bytes<184? 0x30 : 0x10) | (*cc & 0xf);
+        int ptr = 4;
+        if (bytes<184) {
+            int stuffing = 184 - bytes;
+            packet[4] = stuffing - 1;
+            if (stuffing>1) {
+                packet[5] = 0x00;
+                memset(packet+6, 0xff, stuffing-2);
+            }
+            ptr += stuffing;
+        }
+        memcpy(packet+ptr, pes+offset, bytes);
+        offset += bytes;
+        *cc = *cc + 1;
+
+        if (fwrite(packet, 188, 1, file)!=1)
+            dlerror("failed to write synthetic transport stream");
+    }
+}
+
+/* write a transport stream of one program with a video and an audio stream,
+ * returns the number of video pes packets */
+static int write_stream(const char *filename, size_t size)
+{
+    FILE *file = fopen(filename, "wb");
+    if (file==NULL)
+        dlerror("failed to open synthetic transport stream \"%s\"", filename);
+
+    static const unsigned char pat[] = {
+        0x00, 0xb0, 13, 0x00, 0x01, 0xc1, 0x00, 0x00,
+        0x00, 0x01, 0xe0 | (TS_PMT_PID >> 8), TS_PMT_PID & 0xff
+    };
+    static const unsigned char pmt[] = {
+        0x02, 0xb0, 23, 0x00, 0x01, 0xc1, 0x00, 0x00,
+        0xe0 | (TS_VIDEO_PID >> 8), TS_VIDEO_PID & 0xff, 0xf0, 0x00,
+        0x1b, 0xe0 | (TS_VIDEO_PID >> 8), TS_VIDEO_PID & 0xff, 0xf0, 0x00,
+        0x03, 0xe0 | (TS_AUDIO_PID >> 8), TS_AUDIO_PID & 0xff, 0xf0, 0x00
+    };
+
+    /* random payload, the demux does not look at it */
+    unsigned char *payload = (unsigned char *)malloc(TS_PES_SIZE);
+    for (int i=0; i<TS_PES_SIZE; i++)
+        payload[i] = rand();
+
+    int pat_cc = 0, pmt_cc = 0, video_cc = 0, audio_cc = 0;
+    int frames = 0;
+    for (size_t written=0; written<size; frames++) {
+        /* psi once per frame */
+        write_section(file, 0, &pat_cc, pat, sizeof(pat));
+        write_section(file, TS_PMT_PID, &pmt_cc, pmt, sizeof(pmt));
+
+        /* vary the frame size a little */
+        size_t bytes = TS_PES_SIZE - (rand() % (TS_PES_SIZE/4));
+        write_pes(file, TS_VIDEO_PID, &video_cc, 0xe0, frames*3600ll, payload, bytes);
+        write_pes(file, TS_AUDIO_PID, &audio_cc, 0xc0, frames*3600ll, payload, 576);
+        written = ftell(file);
+    }
+
+    free(payload);
+    fclose(file);
+    return frames;
+}
+
+static void bench_demux_source(dlsource *source, const char *name, const char *filename, int frames)
+{
+    if (source->open(filename)<0)
+        dlexit("failed to open synthetic transport stream \"%s\"", filename);
+
+    timing_t t;
+    unsigned long long start = get_utime();
+    unsigned long long cycles = __rdtsc();
+
+    /* find the video stream from the program map */
+    int stream_types[] = { 0x1b };
+    int stream_type;
+    int pid = find_pid_for_stream_type(stream_types, 1, &stream_type, source, 0);
+    if (pid!=TS_VIDEO_PID)
+        dlexit("failed to find video pid in synthetic transport stream");
+    source->rewind(0);
+
+    /* the last pes packet has no following start to terminate it */
+    dltstream *format = new dltstream(pid);
+    format->attach(source);
+    size_t bytes = 0;
+    for (int i=0; i<frames-1; i++) {
+        size_t size;
+        if (format->read(&size)==NULL)
+            dlexit("failed to read pes packet %d of synthetic transport stream", i);
+        bytes += size;
+    }
+
+    t.cycles = __rdtsc() - cycles;
+    t.usecs = get_utime() - start;
+    if (t.usecs==0)
+        t.usecs = 1;
+
+    /* throughput is measured on the whole stream read, not the payload */
+    size_t streamsize = source->size();
+    print_result("demux", name, NULL, 0, 0, frames-1, streamsize, t);
+
+    delete format;
+}
+
+static void bench_demux(size_t size)
+{
+    /* write the stream to a temporary file, left in the page cache */
+    char filename[] = "/tmp/dlbench-XXXXXX.ts";
+    int fd = mkstemps(filename, 3);
+    if (fd<0)
+        dlerror("failed to create synthetic transport stream");
+    close(fd);
+    int frames = write_stream(filename, size);
+
+    dlfile file;
+    bench_demux_source(&file, "file", filename, frames);
+
+    dlmmap mmap;
+    bench_demux_source(&mmap, "mmap", filename, frames);
+
+    dluring uring;
+    bench_demux_source(&uring, "uring", filename, frames);
+
+    unlink(filename);
+}
+
+int main(int argc, char *argv[])
+{
+    /* command line defaults */
+    int numframes = 30;
+    const char *isa = NULL;
+    int threads = 1;
+    int tssize = 64;
+    bool convert = true;
+    bool demux = true;
+    int verbose = 0;
+
+    /* parse command line for options */
+    while (1) {
+        static struct option long_options[] = {
+            {"numframes",  1, NULL, 'n'},
+            {"isa",        1, NULL, 'k'},
+            {"threads",    1, NULL, 'j'},
+            {"size",       1, NULL, 's'},
+            {"no-convert", 0, NULL, 'C'},
+            {"no-demux",   0, NULL, 'D'},
+            {"json",       0, NULL, 'J'},
+            {"quiet",      0, NULL, 'q'},
+            {"verbose",    0, NULL, 'v'},
+            {"usage",      0, NULL, 'u'},
+            {"help",       0, NULL, 'u'},
+            {NULL,         0, NULL,  0 }
+        };
+
+        int optchar = getopt_long(argc, argv, "n:k:j:s:CDJqvu", long_options, NULL);
+        if (optchar==-1)
+            break;
+
+        switch (optchar) {
+            case 'n':
+                numframes = atoi(optarg);
+                if (numframes<=0)
+                    dlexit("invalid value for numframes: %d", numframes);
+                break;
+
+            case 'k':
+                isa = optarg;
+                if (get_kernels(isa)==NULL)
+                    dlexit("instruction set not supported by this cpu: %s", isa);
+                break;
+
+            case 'j':
+                threads = atoi(optarg);
+                if (threads<1 || threads>MAX_POOL_THREADS)
+                    dlexit("invalid value for number of threads: %d", threads);
+                break;
+
+            case 's':
+                tssize = atoi(optarg);
+                if (tssize<=0)
+                    dlexit("invalid value for transport stream size: %d", tssize);
+                break;
+
+            case 'C':
+                convert = false;
+                break;
+
+            case 'D':
+                demux = false;
+                break;
+
+            case 'J':
+                json = true;
+                break;
+
+            case 'q':
+                verbose--;
+                break;
+
+            case 'v':
+                verbose++;
+                break;
+
+            case 'u':
+                usage(0);
+                break;
+
+            case '?':
+                exit(1);
+                break;
+        }
+    }
+
+    if (optind<argc)
+        usage(1);
+
+    convert_set_threads(threads);
+
+    if (verbose>=0 && !json)
+        dlmessage("info: best instruction set is %s, using %d thread%s", get_kernels()->isa, threads, threads>1? "s" : "");
+
+    if (json)
+        printf("{\n  \"isa\": \"%s\",\n  \"threads\": %d,\n  \"results\": [\n", get_kernels()->isa, threads);
+
+    if (convert)
+        bench_convert(isa, numframes);
+    if (demux)
+        bench_demux(tssize*1024ll*1024ll);
+
+    if (json)
+        printf("\n  ]\n}\n");
+
+    /* tidy up */
+    convert_set_threads(1);
+
+    return 0;
+}
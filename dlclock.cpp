@@ -0,0 +1,192 @@
+/*
+ * Description: recovery of the encoder clock of a live stream.
+ * Author     : Ryan Dalzell
+ * Copyright  : (c) 2026 4i2i Communications Ltd.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "dlutil.h"
+#include "dlclock.h"
+
+/* software phase locked loop */
+dlpll::dlpll(long long w)
+{
+    wrap = w;
+    unwrap = 0;
+    last = 0;
+    started = false;
+    start = base = 0;
+    phase = 0.0;
+    frequency = 1.0;
+}
+
+bool dlpll::add(sts_t time, unsigned long long utime)
+{
+    /* unwrap the remote clock */
+    if (wrap && started && time<last-wrap/2)
+        unwrap += wrap;
+    last = time;
+    time += unwrap;
+
+    if (!started) {
+        /* the frequency of the clock is kept from before a restart */
+        started = true;
+        start = base = utime;
+        phase = time;
+        return true;
+    }
+
+    /* the phase error against the model of the remote clock */
+    double dt = utime>base? (utime-base)/1000000.0 : 0.0;
+    double predicted = phase + frequency*dt*180000.0;
+    double error = time - predicted;
+    if (fabs(error)>180000.0) {
+        /* a jump of more than a second is a new clock */
+        started = false;
+        unwrap = 0;
+        add(last, utime);
+        return false;
+    }
+
+    /* a proportional and integral loop filter, critically damped, with a wide bandwidth to acquire */
+    double bandwidth = utime-start<CLOCK_ACQUIRE*1000000ull? 10*CLOCK_BANDWIDTH : CLOCK_BANDWIDTH;
+    double wn = 2.0*M_PI*bandwidth;
+    phase = predicted + mmin(2.0*0.707*wn*dt, 1.0)*error;
+    frequency += wn*wn*dt*error/180000.0;
+    base = mmax(base, utime);
+
+    /* the clocks of an encoder and an output are within a few tens of parts per million */
+    frequency = mmax(0.999, mmin(1.001, frequency));
+
+    return true;
+}
+
+sts_t dlpll::at(unsigned long long utime)
+{
+    return llround(phase + frequency*((double)utime-(double)base)*0.18);
+}
+
+bool dlpll::locked()
+{
+    return started && base-start>=2*CLOCK_ACQUIRE*1000000ull;
+}
+
+/* clock recovery */
+dlclock::dlclock() : encoder(1ll<<34)
+{
+    offset = 0;
+    repeated = dropped = 0;
+    referenced = false;
+    latency = 0.0;
+    audio_offset = 0.0;
+    audio_remainder = 0.0;
+}
+
+void dlclock::add_pcr(long long pcr, unsigned long long arrival)
+{
+    /* in 180kHz units the 33-bit base of the pcr wraps at 2^34 */
+    if (!encoder.add(pcr/150, arrival)) {
+        dlmessage("discontinuity in the program clock of the stream, recovering the encoder clock again");
+        referenced = false;
+    }
+}
+
+void dlclock::add_output(sts_t time, unsigned long long utime)
+{
+    if (!output.add(time, utime))
+        referenced = false;
+}
+
+double dlclock::ratio()
+{
+    return encoder.rate()/output.rate();
+}
+
+double dlclock::drift(unsigned long long utime)
+{
+    /* once both clocks are locked, the latency is measured against the offset of the video */
+    if (!referenced) {
+        if (!encoder.locked() || !output.locked())
+            return 0.0;
+        referenced = true;
+        latency = encoder.at(utime) - output.at(utime) + offset;
+        audio_offset = offset;
+        audio_remainder = 0.0;
+    }
+
+    return encoder.at(utime) - output.at(utime) - latency;
+}
+
+int dlclock::adjust_video(sts_t duration, unsigned long long utime)
+{
+    double d = drift(utime) + offset;
+    if (!referenced)
+        return 0;
+
+    /* the encoder is ahead, so frames are arriving faster than they are displayed */
+    if (d>0.75*duration) {
+        offset -= duration;
+        dropped++;
+        return -1;
+    }
+
+    /* the encoder is behind */
+    if (d<-0.75*duration) {
+        offset += duration;
+        repeated++;
+        return 1;
+    }
+
+    return 0;
+}
+
+int dlclock::adjust_audio(int frames, int samplerate, unsigned long long utime, sts_t *o)
+{
+    double d = drift(utime);
+    if (!referenced) {
+        *o = offset;
+        return frames;
+    }
+
+    /* steer the offset of the audio towards that which holds the latency, by a fraction of a sample per block */
+    double error = (-d - audio_offset)*samplerate/180000.0;
+    double limit = frames*CLOCK_MAX_STRETCH/1000000.0;
+    double stretch = mmax(-limit, mmin(limit, error/8.0));
+    double exact = frames + stretch + audio_remainder;
+    int resampled = (int)floor(exact);
+    audio_remainder = exact - resampled;
+
+    *o = llround(audio_offset);
+    audio_offset += (resampled-frames)*180000.0/samplerate;
+    return resampled;
+}
+
+/* resample by linear interpolation, the first and last sample frames are kept */
+void resample_audio(const int16_t *in, int in_frames, int16_t *out, int out_frames, int channels)
+{
+    if (in_frames<2 || out_frames<2) {
+        for (int i=0; i<out_frames; i++)
+            memcpy(out+i*channels, in+mmin(i, in_frames-1)*channels, channels*sizeof(int16_t));
+        return;
+    }
+
+    /* step through the input in 16.16 fixed point */
+    unsigned long long step = ((unsigned long long)(in_frames-1)<<16) / (out_frames-1);
+    unsigned long long pos = 0;
+    for (int i=0; i<out_frames; i++, pos+=step) {
+        int j = pos >> 16;
+        int frac = pos & 0xffff;
+        if (j>=in_frames-1) {
+            j = in_frames-2;
+            frac = 0x10000;
+        }
+        for (int c=0; c<channels; c++) {
+            int a = in[j*channels+c];
+            int b = in[(j+1)*channels+c];
+            out[i*channels+c] = a + (int)(((long long)(b-a)*frac) >> 16);
+        }
+    }
+}
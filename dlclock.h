@@ -0,0 +1,96 @@
+#ifndef DLCLOCK_H
+#define DLCLOCK_H
+
+#include <stdint.h>
+
+#include "dlutil.h"
+
+/* bandwidth in Hz of the clock recovery loops, the loops are opened out to ten times this while
+ * they acquire, and are locked after twice the acquisition time in seconds */
+#define CLOCK_BANDWIDTH 0.01
+#define CLOCK_ACQUIRE 30
+
+/* largest correction of the length of a block of audio, in parts per million */
+#define CLOCK_MAX_STRETCH 1000
+
+/* software phase locked loop, a second order loop which locks a local model of a remote clock to
+ * samples of it stamped with the local time, filtering the jitter of their arrival */
+class dlpll
+{
+public:
+    /* the remote clock wraps modulo the given number of ticks, or zero if it does not */
+    dlpll(long long wrap=0);
+
+    /* add a sample of the remote clock in 180kHz units with the local time in usecs,
+     * returns false on a discontinuity, which restarts the loop */
+    bool add(sts_t time, unsigned long long utime);
+    void reset() { started = false; }
+
+    /* the remote clock, unwrapped, at a local time */
+    sts_t at(unsigned long long utime);
+    /* rate of the remote clock against the local clock */
+    double rate() { return frequency; }
+    bool locked();
+
+private:
+    long long wrap;
+    sts_t last;
+    long long unwrap;
+
+    /* state of the loop, the phase of the remote clock at the local time of the last sample */
+    bool started;
+    unsigned long long start;
+    unsigned long long base;
+    double phase;
+    double frequency;
+};
+
+/* clock recovery class, the encoder clock is recovered from the program clock references of a
+ * stream and compared with the output clock, the difference between them is the latency of the
+ * playout, which is held constant by repeating or dropping a video frame when it has drifted by
+ * most of a frame, and by stretching each block of audio by a fraction of a sample */
+class dlclock
+{
+public:
+    dlclock();
+
+    /* add a program clock reference in 27MHz units with its time of arrival in usecs */
+    void add_pcr(long long pcr, unsigned long long arrival);
+    /* add the stream time of the output in 180kHz units at a local time in usecs */
+    void add_output(sts_t time, unsigned long long utime);
+
+    /* both clocks are locked and the latency has been measured */
+    bool locked() { return referenced; }
+    /* rate of the encoder clock against the output clock */
+    double ratio();
+
+    /* returns -1 to drop the next video frame, 1 to leave the slot before it empty so the last
+     * frame is repeated, or 0, the offset is added to the timestamp of the frame to schedule it */
+    int adjust_video(sts_t duration, unsigned long long utime);
+    sts_t offset;
+
+    /* the number of sample frames to resample a block of audio to, and the offset to add to its
+     * timestamp to schedule it */
+    int adjust_audio(int frames, int samplerate, unsigned long long utime, sts_t *offset);
+
+    /* statistics */
+    unsigned long long repeated;
+    unsigned long long dropped;
+
+private:
+    /* drift of the latency from when it was measured, in 180kHz units */
+    double drift(unsigned long long utime);
+
+    dlpll encoder, output;
+    bool referenced;
+    double latency;
+
+    /* audio is scheduled with a continuous offset, and whole samples with the remainder carried */
+    double audio_offset;
+    double audio_remainder;
+};
+
+/* resample interleaved 16-bit audio to a slightly different number of sample frames */
+void resample_audio(const int16_t *in, int in_frames, int16_t *out, int out_frames, int channels);
+
+#endif
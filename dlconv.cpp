@@ -5,214 +5,349 @@
  */
 
 #include "dlutil.h"
+#include "dlconv.h"
+#include "dlkernel.h"
+#include "dlpool.h"
 
 #ifdef HAVE_LIBYUV
 #include <libyuv.h>
 #endif
 
-static void convert_i444_uyvy(const unsigned char *i444, unsigned char *uyvy, int width, int height)
+void picture_init(picture_t *pic, const unsigned char *buf, int width, int height, pixelformat_t pixelformat, int rowbytes)
 {
-    const unsigned char *yuv[3] = {i444};
-    for (int y=0; y<height; y++) {
-        yuv[1] = i444 + width*height + width*y;
-        yuv[2] = i444 + width*height*2 + width*y;
-        for (int x=0; x<width/2; x++) {
-            *(uyvy++) = *yuv[1];
-            *(uyvy++) = *(yuv[0]++);
-            *(uyvy++) = *yuv[2];
-            *(uyvy++) = *(yuv[0]++);
-            yuv[1] += 2;
-            yuv[2] += 2;
-        }
+    const int bytes = pixelformat_is_8bit(pixelformat)? 1 : 2;
+
+    pic->width = width;
+    pic->height = height;
+    pic->pixelformat = pixelformat;
+    pic->bitdepth = pixelformat_is_8bit(pixelformat)? 8 : 10;
+    pic->siting = SITING_LEFT;
+    pic->picstruct = FRAME_PICTURE;
+    pic->nontemporal = false;
+    pic->data[0] = (unsigned char *)buf;
+    pic->data[1] = pic->data[2] = NULL;
+    pic->stride[1] = pic->stride[2] = 0;
+
+    switch (pixelformat) {
+        case UYVY: pic->stride[0] = rowbytes? rowbytes : 2*width; return;
+        case V210: pic->stride[0] = rowbytes? rowbytes : ((width+47)/48)*128; return;
+        default  : pic->stride[0] = rowbytes? rowbytes : bytes*width; break;
+    }
+
+    /* semi-planar formats, with both chroma planes pointing at the interleaved plane */
+    const int cheight = pixelformat==I420 || pixelformat==YU15 || pixelformat==P010? height/2 : height;
+    if (pixelformat==P010 || pixelformat==P210) {
+        pic->stride[1] = pic->stride[2] = pic->stride[0];
+        if (buf)
+            pic->data[1] = pic->data[2] = pic->data[0] + pic->stride[0]*height;
+        return;
+    }
+
+    /* planar formats */
+    const int cstride = pixelformat==I444? pic->stride[0] : pic->stride[0]/2;
+    pic->stride[1] = pic->stride[2] = cstride;
+    if (buf) {
+        pic->data[1] = pic->data[0] + pic->stride[0]*height;
+        pic->data[2] = pic->data[1] + cstride*cheight;
     }
 }
 
-void convert_i420_uyvy(const unsigned char *i420, unsigned char *uyvy, int width, int height, pixelformat_t pixelformat)
+picture_t picture_field(const picture_t *frame, bool bottom)
 {
-    const unsigned char *yuv[3] = {i420};
-
-    if (pixelformat==I444)
-        return convert_i444_uyvy(i420, uyvy, width, height);
+    picture_t field = *frame;
 
-    /* otherwise for 4:2:0 and 4:2:2 */
-    for (int y=0; y<height; y++) {
-        if (pixelformat==I422) {
-            yuv[1] = i420 + width*height + (width/2)*y;
-            yuv[2] = i420 + width*height*6/4 + (width/2)*y;
-        } else {
-            yuv[1] = i420 + width*height + (width/2)*(y/2);
-            yuv[2] = i420 + width*height*5/4 + (width/2)*(y/2);
-        }
-        for (int x=0; x<width/2; x++) {
-            *(uyvy++) = *(yuv[1]++);
-            *(uyvy++) = *(yuv[0]++);
-            *(uyvy++) = *(yuv[2]++);
-            *(uyvy++) = *(yuv[0]++);
-        }
+    /* every other row of each plane */
+    for (int p=0; p<3; p++) {
+        if (bottom && field.data[p])
+            field.data[p] += frame->stride[p];
+        field.stride[p] = 2*frame->stride[p];
     }
+    field.height = bottom? frame->height/2 : (frame->height+1)/2;
+    field.picstruct = bottom? BOTTOM_FIELD : TOP_FIELD;
+
+    return field;
 }
 
-void convert_yu20_v210(const unsigned char *yu20, unsigned char *uyvy, int width, int height, pixelformat_t pixelformat)
+/* optional worker pool for slice-parallel conversion */
+static dlpool *pool = NULL;
+
+void convert_set_threads(int threads)
 {
-    const int rowbytes = ((width+47)/48)*128;
+    if (pool)
+        delete pool;
+    pool = threads>1? new dlpool(threads) : NULL;
+}
 
-    /* otherwise for 4:2:0 and 4:2:2 */
-    for (int y=0; y<height; y++) {
-        const uint16_t *yuv[3];
-        yuv[0] = (uint16_t*)yu20 + width*y;
-        if (pixelformat==YU20) {
-            yuv[1] = (uint16_t*)yu20 + width*height + (width/2)*y;
-            yuv[2] = (uint16_t*)yu20 + width*height*6/4 + (width/2)*y;
-        } else { /* YU15 */
-            yuv[1] = (uint16_t*)yu20 + width*height + (width/2)*(y/2);
-            yuv[2] = (uint16_t*)yu20 + width*height*5/4 + (width/2)*(y/2);
-        }
-        uint32_t *v210 = (uint32_t *) (uyvy + (rowbytes * y));
-        for (int x=0; x<width/6; x++) {
-            *(v210++) = uint32_t(*(yuv[2]+0))<<20 | uint32_t(*(yuv[0]+0))<<10 | uint32_t(*(yuv[1]+0));
-            *(v210++) = uint32_t(*(yuv[0]+2))<<20 | uint32_t(*(yuv[1]+1))<<10 | uint32_t(*(yuv[0]+1));
-            *(v210++) = uint32_t(*(yuv[1]+2))<<20 | uint32_t(*(yuv[0]+3))<<10 | uint32_t(*(yuv[2]+1));
-            *(v210++) = uint32_t(*(yuv[0]+5))<<20 | uint32_t(*(yuv[2]+2))<<10 | uint32_t(*(yuv[0]+4));
-            yuv[0] += 6;
-            yuv[1] += 3;
-            yuv[2] += 3;
-        }
-    }
+/* optional override of the row kernels selected for this cpu */
+static const kernels_t *isa_kernels = NULL;
+
+int convert_set_isa(const char *isa)
+{
+    const kernels_t *k = isa? get_kernels(isa) : get_kernels();
+    if (k==NULL)
+        return -1;
+    isa_kernels = k;
+    return 0;
 }
 
-void convert_yuv_uyvy(const unsigned char *yuv[3], unsigned char *uyvy, int width, int height, pixelformat_t pixelformat)
+/* a conversion shared by all bands of a picture */
+typedef struct {
+    const picture_t *src;
+    const picture_t *dst;
+    kernels_t kernels;
+} convert_job_t;
+
+/* chroma subsampling of the source */
+enum { SUB_420, SUB_422, SUB_444 };
+
+/* packing of the destination */
+enum { PACK_UYVY, PACK_V210, PACK_V210_SEMI, PACK_LUMA };
+
+/* row of a source plane */
+template <typename T>
+static inline const T *src_row(const picture_t *pic, int plane, int row)
 {
-#ifndef HAVE_LIBYUV
-    const unsigned char *ptr[3] = {yuv[0]};
-    for (int y=0; y<height; y++) {
-        if (pixelformat==I422) {
-            ptr[1] = yuv[1] + (width/2)*y;
-            ptr[2] = yuv[2] + (width/2)*y;
-        } else {
-            ptr[1] = yuv[1] + (width/2)*(y/2);
-            ptr[2] = yuv[2] + (width/2)*(y/2);
-        }
-        for (int x=0; x<width/2; x++) {
-            *(uyvy++) = *(ptr[1]++);
-            *(uyvy++) = *(ptr[0]++);
-            *(uyvy++) = *(ptr[2]++);
-            *(uyvy++) = *(ptr[0]++);
-        }
-    }
-#else
-    switch (pixelformat) {
-        case I420: libyuv::I420ToUYVY(yuv[0], width, yuv[1], width/2, yuv[2], width/2, uyvy, 2*width, width, height); break;
-        case I422: libyuv::I422ToUYVY(yuv[0], width, yuv[1], width/2, yuv[2], width/2, uyvy, 2*width, width, height); break;
-        case I444: convert_i444_uyvy(yuv[0], uyvy, width, height); break;   /* no suitable accelerated routine in libyuv */
-        case YU15: convert_yu20_v210(yuv[0], uyvy, width, height, pixelformat); break;
-        case YU20: convert_yu20_v210(yuv[0], uyvy, width, height, pixelformat); break;
-        default  : dlexit("unknown pixel format in conversion: %s", pixelformatname[pixelformat]);
-    }
-#endif
+    return (const T *)(pic->data[plane] + pic->stride[plane]*row);
 }
 
-void convert_i420_uyvy_lumaonly(const unsigned char *i420, unsigned char *uyvy, int width, int height)
+/* chroma row of a luma row */
+template <int SUB>
+static inline int chroma_row(int row)
 {
-    for (int y=0; y<height; y++) {
+    return SUB==SUB_420? row/2 : row;
+}
+
+/* row of the destination frame, every other row when writing one field */
+template <int FIELD>
+static inline unsigned char *dst_row(const picture_t *pic, int row)
+{
+    if (FIELD==FRAME_PICTURE)
+        return pic->data[0] + pic->stride[0]*row;
+    return pic->data[0] + pic->stride[0]*(2*row + (FIELD==BOTTOM_FIELD));
+}
+
+template <int FIELD>
+static inline int dst_pitch(const picture_t *pic)
+{
+    return FIELD==FRAME_PICTURE? pic->stride[0] : 2*pic->stride[0];
+}
+
+/* pack one or two rows, y1 and out1 are a second row sharing the same chroma or null */
+template <int SUB, typename T, int PACK>
+struct pack_rows;
+
+/* 8-bit 4:2:0 and 4:2:2 to uyvy */
+template <int SUB>
+struct pack_rows<SUB, uint8_t, PACK_UYVY> {
+    static inline void run(const kernels_t *k, const uint8_t *y0, const uint8_t *y1, const uint8_t *u, const uint8_t *v, unsigned char *out0, unsigned char *out1, int width)
+    {
+        k->row_422_uyvy(y0, u, v, out0, width);
+        if (y1)
+            k->row_422_uyvy(y1, u, v, out1, width);
+    }
+};
+
+/* 8-bit 4:4:4 to uyvy with chroma decimation */
+template <>
+struct pack_rows<SUB_444, uint8_t, PACK_UYVY> {
+    static inline void run(const kernels_t *k, const uint8_t *y0, const uint8_t *y1, const uint8_t *u, const uint8_t *v, unsigned char *out0, unsigned char *out1, int width)
+    {
+        k->row_444_uyvy(y0, u, v, out0, width);
+    }
+};
+
+/* 10-bit 4:2:0 and 4:2:2 to v210 */
+template <int SUB>
+struct pack_rows<SUB, uint16_t, PACK_V210> {
+    static inline void run(const kernels_t *k, const uint16_t *y0, const uint16_t *y1, const uint16_t *u, const uint16_t *v, unsigned char *out0, unsigned char *out1, int width)
+    {
+        k->row_v210(y0, y1, u, v, out0, out1, width);
+    }
+};
+
+/* 10-bit semi-planar 4:2:0 and 4:2:2 to v210, u is the interleaved chroma row */
+template <int SUB>
+struct pack_rows<SUB, uint16_t, PACK_V210_SEMI> {
+    static inline void run(const kernels_t *k, const uint16_t *y0, const uint16_t *y1, const uint16_t *u, const uint16_t *v, unsigned char *out0, unsigned char *out1, int width)
+    {
+        k->row_p210_v210(y0, y1, u, out0, out1, width);
+    }
+};
+
+/* 8-bit luma only to uyvy with neutral chroma */
+template <int SUB>
+struct pack_rows<SUB, uint8_t, PACK_LUMA> {
+    static inline void row(const uint8_t *y, unsigned char *uyvy, int width)
+    {
         for (int x=0; x<width/2; x++) {
             *(uyvy++) = 0x80;
-            *(uyvy++) = *(i420++);
+            *(uyvy++) = *(y++);
             *(uyvy++) = 0x80;
-            *(uyvy++) = *(i420++);
+            *(uyvy++) = *(y++);
         }
     }
-}
 
-void convert_field_yuv_uyvy(const unsigned char *top[3], const unsigned char *bot[3], unsigned char *uyvy, int width, int height, pixelformat_t pixelformat)
-{
-    const unsigned char *ptr[2][3] = {{top[0]}, {bot[0]}};
-    for (int y=0; y<height/2; y++) {
-        if (pixelformat==I422) {
-            ptr[0][1] = top[1] + (width/2)*y;
-            ptr[0][2] = top[2] + (width/2)*y;
-            ptr[1][1] = bot[1] + (width/2)*y;
-            ptr[1][2] = bot[2] + (width/2)*y;
-        } else {
-            ptr[0][1] = top[1] + (width/2)*(y/2);
-            ptr[0][2] = top[2] + (width/2)*(y/2);
-            ptr[1][1] = bot[1] + (width/2)*(y/2);
-            ptr[1][2] = bot[2] + (width/2)*(y/2);
-        }
-        /* first field */
-        for (int x=0; x<width/2; x++) {
-            *(uyvy++) = *(ptr[0][1]++);
-            *(uyvy++) = *(ptr[0][0]++);
-            *(uyvy++) = *(ptr[0][2]++);
-            *(uyvy++) = *(ptr[0][0]++);
-        }
-        /* second field */
-        for (int x=0; x<width/2; x++) {
-            *(uyvy++) = *(ptr[1][1]++);
-            *(uyvy++) = *(ptr[1][0]++);
-            *(uyvy++) = *(ptr[1][2]++);
-            *(uyvy++) = *(ptr[1][0]++);
-        }
+    static inline void run(const kernels_t *k, const uint8_t *y0, const uint8_t *y1, const uint8_t *u, const uint8_t *v, unsigned char *out0, unsigned char *out1, int width)
+    {
+        row(y0, out0, width);
+        if (y1)
+            row(y1, out1, width);
     }
-}
+};
 
-void convert_top_field_yuv_uyvy(const unsigned char *top[3], unsigned char *uyvy, int width, int height, pixelformat_t pixelformat)
+/* convert a band of rows, specialised at compile time for the source subsampling
+ * and sample type, the destination field and the output packing */
+template <int SUB, typename T, int FIELD, int PACK>
+static void convert_band(void *arg, int first, int last)
 {
-#ifndef HAVE_LIBYUV
-    const unsigned char *ptr[3] = {top[0]};
-    for (int y=0; y<height/2; y++) {
-        if (pixelformat==I422) {
-            ptr[1] = top[1] + (width/2)*y;
-            ptr[2] = top[2] + (width/2)*y;
-        } else {
-            ptr[1] = top[1] + (width/2)*(y/2);
-            ptr[2] = top[2] + (width/2)*(y/2);
-        }
-        /* first field */
-        for (int x=0; x<width/2; x++) {
-            *(uyvy++) = *(ptr[1]++);
-            *(uyvy++) = *(ptr[0]++);
-            *(uyvy++) = *(ptr[2]++);
-            *(uyvy++) = *(ptr[0]++);
-        }
-        /* second field */
-        uyvy += 2*width;
-    }
-#else
-    switch (pixelformat) {
-        case I420: libyuv::I420ToUYVY(top[0], width, top[1], width/2, top[2], width/2, uyvy, 4*width, width, height/2); break;
-        case I422: libyuv::I422ToUYVY(top[0], width, top[1], width/2, top[2], width/2, uyvy, 4*width, width, height/2); break;
-        default  : dlerror("unknown pixel format in conversion: %s", pixelformatname[pixelformat]);
+    const convert_job_t *job = (const convert_job_t *)arg;
+    const picture_t *src = job->src;
+    const picture_t *dst = job->dst;
+    const int width = src->width;
+
+    /* vectorised row kernels for this cpu */
+    const kernels_t *kernels = &job->kernels;
+
+    /* 4:2:0 rows are converted in pairs sharing a row of chroma */
+    const int step = SUB==SUB_420? 2 : 1;
+    for (int y=first; y<last; y+=step) {
+        const bool pair = step==2 && y+1<last;
+        pack_rows<SUB, T, PACK>::run(kernels,
+                                     src_row<T>(src, 0, y), pair? src_row<T>(src, 0, y+1) : NULL,
+                                     src_row<T>(src, 1, chroma_row<SUB>(y)), src_row<T>(src, 2, chroma_row<SUB>(y)),
+                                     dst_row<FIELD>(dst, y), pair? dst_row<FIELD>(dst, y+1) : NULL, width);
     }
+}
+
+#ifdef HAVE_LIBYUV
+/* accelerated 4:2:0 and 4:2:2 to uyvy */
+template <int SUB, int FIELD>
+static void convert_band_libyuv(void *arg, int first, int last)
+{
+    const convert_job_t *job = (const convert_job_t *)arg;
+    const picture_t *src = job->src;
+    const picture_t *dst = job->dst;
+
+    const unsigned char *y = src_row<uint8_t>(src, 0, first);
+    const unsigned char *u = src_row<uint8_t>(src, 1, chroma_row<SUB>(first));
+    const unsigned char *v = src_row<uint8_t>(src, 2, chroma_row<SUB>(first));
+    if (SUB==SUB_420)
+        libyuv::I420ToUYVY(y, src->stride[0], u, src->stride[1], v, src->stride[2], dst_row<FIELD>(dst, first), dst_pitch<FIELD>(dst), src->width, last-first);
+    else
+        libyuv::I422ToUYVY(y, src->stride[0], u, src->stride[1], v, src->stride[2], dst_row<FIELD>(dst, first), dst_pitch<FIELD>(dst), src->width, last-first);
+}
 #endif
+
+/* table of specialised conversions */
+typedef struct {
+    pixelformat_t pixelformat;
+    int pack;
+    picstruct_t field;
+    band_job_t band;
+} conversion_t;
+
+#define CONVERSION(format, pack, band) \
+    {format, pack, FRAME_PICTURE, band<FRAME_PICTURE>}, \
+    {format, pack, TOP_FIELD,     band<TOP_FIELD>}, \
+    {format, pack, BOTTOM_FIELD,  band<BOTTOM_FIELD>}
+
+#ifdef HAVE_LIBYUV
+/* libyuv has no non-temporal stores, so use the kernels for streaming output */
+template <int FIELD> static void convert_band_i420_uyvy(void *arg, int first, int last)
+{
+    if (((const convert_job_t *)arg)->dst->nontemporal)
+        convert_band<SUB_420, uint8_t, FIELD, PACK_UYVY>(arg, first, last);
+    else
+        convert_band_libyuv<SUB_420, FIELD>(arg, first, last);
+}
+template <int FIELD> static void convert_band_i422_uyvy(void *arg, int first, int last)
+{
+    if (((const convert_job_t *)arg)->dst->nontemporal)
+        convert_band<SUB_422, uint8_t, FIELD, PACK_UYVY>(arg, first, last);
+    else
+        convert_band_libyuv<SUB_422, FIELD>(arg, first, last);
 }
+#else
+template <int FIELD> static void convert_band_i420_uyvy(void *arg, int first, int last) { convert_band<SUB_420, uint8_t, FIELD, PACK_UYVY>(arg, first, last); }
+template <int FIELD> static void convert_band_i422_uyvy(void *arg, int first, int last) { convert_band<SUB_422, uint8_t, FIELD, PACK_UYVY>(arg, first, last); }
+#endif
+template <int FIELD> static void convert_band_i444_uyvy(void *arg, int first, int last) { convert_band<SUB_444, uint8_t, FIELD, PACK_UYVY>(arg, first, last); }
+template <int FIELD> static void convert_band_yu15_v210(void *arg, int first, int last) { convert_band<SUB_420, uint16_t, FIELD, PACK_V210>(arg, first, last); }
+template <int FIELD> static void convert_band_yu20_v210(void *arg, int first, int last) { convert_band<SUB_422, uint16_t, FIELD, PACK_V210>(arg, first, last); }
+template <int FIELD> static void convert_band_p010_v210(void *arg, int first, int last) { convert_band<SUB_420, uint16_t, FIELD, PACK_V210_SEMI>(arg, first, last); }
+template <int FIELD> static void convert_band_p210_v210(void *arg, int first, int last) { convert_band<SUB_422, uint16_t, FIELD, PACK_V210_SEMI>(arg, first, last); }
+template <int FIELD> static void convert_band_i420_luma(void *arg, int first, int last) { convert_band<SUB_420, uint8_t, FIELD, PACK_LUMA>(arg, first, last); }
+template <int FIELD> static void convert_band_i422_luma(void *arg, int first, int last) { convert_band<SUB_422, uint8_t, FIELD, PACK_LUMA>(arg, first, last); }
+template <int FIELD> static void convert_band_i444_luma(void *arg, int first, int last) { convert_band<SUB_444, uint8_t, FIELD, PACK_LUMA>(arg, first, last); }
 
-void convert_bot_field_yuv_uyvy(const unsigned char *bot[3], unsigned char *uyvy, int width, int height, pixelformat_t pixelformat)
+static const conversion_t conversions[] = {
+    CONVERSION(I420, PACK_UYVY, convert_band_i420_uyvy),
+    CONVERSION(I422, PACK_UYVY, convert_band_i422_uyvy),
+    CONVERSION(I444, PACK_UYVY, convert_band_i444_uyvy),
+    CONVERSION(YU15, PACK_V210, convert_band_yu15_v210),
+    CONVERSION(YU20, PACK_V210, convert_band_yu20_v210),
+    CONVERSION(P010, PACK_V210, convert_band_p010_v210),
+    CONVERSION(P210, PACK_V210, convert_band_p210_v210),
+    CONVERSION(I420, PACK_LUMA, convert_band_i420_luma),
+    CONVERSION(I422, PACK_LUMA, convert_band_i422_luma),
+    CONVERSION(I444, PACK_LUMA, convert_band_i444_luma),
+};
+
+/* find the specialised conversion and run it over the picture, on the worker pool if there is one */
+static void convert(const picture_t *src, const picture_t *dst, int pack)
 {
-#ifndef HAVE_LIBYUV
-    const unsigned char *ptr[3] = {bot[0]};
-    for (int y=0; y<height/2; y++) {
-        if (pixelformat==I422) {
-            ptr[1] = bot[1] + (width/2)*y;
-            ptr[2] = bot[2] + (width/2)*y;
-        } else {
-            ptr[1] = bot[1] + (width/2)*(y/2);
-            ptr[2] = bot[2] + (width/2)*(y/2);
-        }
-        /* first field */
-        uyvy += 2*width;
-        /* second field */
-        for (int x=0; x<width/2; x++) {
-            *(uyvy++) = *(ptr[1]++);
-            *(uyvy++) = *(ptr[0]++);
-            *(uyvy++) = *(ptr[2]++);
-            *(uyvy++) = *(ptr[0]++);
+    /* a field picture is written to every other row of a frame */
+    const picstruct_t field = dst->picstruct==FRAME_PICTURE? src->picstruct : FRAME_PICTURE;
+
+    const conversion_t *c = NULL;
+    for (unsigned i=0; i<sizeof(conversions)/sizeof(conversions[0]); i++)
+        if (conversions[i].pixelformat==src->pixelformat && conversions[i].pack==pack && conversions[i].field==field) {
+            c = &conversions[i];
+            break;
         }
+    if (c==NULL)
+        dlexit("unknown pixel format in conversion: %s to %s", pixelformatname[src->pixelformat], pixelformatname[dst->pixelformat]);
+
+    /* rows of 4:2:0 chroma are shared by pairs of luma rows, so bands must start on an even row */
+    const int granularity = src->pixelformat==I420 || src->pixelformat==YU15 || src->pixelformat==P010? 2 : 1;
+    const int rows = field==FRAME_PICTURE? mmin(src->height, dst->height) : mmin(src->height, (dst->height+(field==TOP_FIELD))/2);
+
+    /* select the row kernels for the destination */
+    convert_job_t job = {src, dst, isa_kernels? *isa_kernels : *get_kernels()};
+    if (dst->nontemporal) {
+        job.kernels.row_444_uyvy = job.kernels.row_444_uyvy_nt;
+        job.kernels.row_422_uyvy = job.kernels.row_422_uyvy_nt;
+        job.kernels.row_v210 = job.kernels.row_v210_nt;
+        job.kernels.row_p210_v210 = job.kernels.row_p210_v210_nt;
     }
-#else
-    switch (pixelformat) {
-        case I420: libyuv::I420ToUYVY(bot[0], width, bot[1], width/2, bot[2], width/2, uyvy+2*width, 4*width, width, height/2); break;
-        case I422: libyuv::I422ToUYVY(bot[0], width, bot[1], width/2, bot[2], width/2, uyvy+2*width, 4*width, width, height/2); break;
-        default  : dlerror("unknown pixel format in conversion: %s", pixelformatname[pixelformat]);
-    }
-#endif
+
+    if (pool)
+        pool->run(c->band, &job, rows, granularity);
+    else
+        c->band(&job, 0, rows);
+}
+
+void convert_yuv_uyvy(const picture_t *src, const picture_t *dst)
+{
+    convert(src, dst, dst->pixelformat==V210? PACK_V210 : PACK_UYVY);
+}
+
+void convert_yu20_v210(const picture_t *src, const picture_t *dst)
+{
+    convert(src, dst, PACK_V210);
+}
+
+void convert_i420_uyvy_lumaonly(const picture_t *src, const picture_t *dst)
+{
+    convert(src, dst, PACK_LUMA);
+}
+
+void convert_field_yuv_uyvy(const picture_t *top, const picture_t *bot, const picture_t *dst)
+{
+    picture_t field = *top;
+    field.picstruct = TOP_FIELD;
+    convert_yuv_uyvy(&field, dst);
+    field = *bot;
+    field.picstruct = BOTTOM_FIELD;
+    convert_yuv_uyvy(&field, dst);
 }
@@ -3,11 +3,49 @@
 
 #include "dlutil.h"
 
-void convert_i420_uyvy(const unsigned char *i420, unsigned char *uyvy, int width, int height, pixelformat_t pixelformat);
-void convert_yuv_uyvy(const unsigned char *yuv[3], unsigned char *uyvy, int width, int height, pixelformat_t pixelformat);
-void convert_i420_uyvy_lumaonly(const unsigned char *i420, unsigned char *uyvy, int width, int height);
-void convert_field_yuv_uyvy(const unsigned char *top[3], const unsigned char *bot[3], unsigned char *uyvy, int width, int height, pixelformat_t pixelformat);
-void convert_top_field_yuv_uyvy(const unsigned char *top[3], unsigned char *uyvy, int width, int height, pixelformat_t pixelformat);
-void convert_bot_field_yuv_uyvy(const unsigned char *bot[3], unsigned char *uyvy, int width, int height, pixelformat_t pixelformat);
+/* chroma sample siting of subsampled pictures */
+typedef enum {
+    SITING_LEFT,        /* co-sited with the left luma sample, as mpeg-2 and later */
+    SITING_CENTRE       /* between luma samples, as mpeg-1 and jpeg */
+} chromasiting_t;
+
+/* picture structure */
+typedef enum {
+    FRAME_PICTURE,
+    TOP_FIELD,
+    BOTTOM_FIELD
+} picstruct_t;
+
+/* picture descriptor, the planes of a picture in memory with their row pitch
+ * in bytes, used for both decoder output and the destination frame buffer */
+typedef struct {
+    unsigned char *data[3];
+    int stride[3];
+    int width;
+    int height;
+    pixelformat_t pixelformat;
+    int bitdepth;
+    chromasiting_t siting;
+    picstruct_t picstruct;
+    bool nontemporal;   /* write with non-temporal stores, the cpu does not read it again */
+} picture_t;
+
+/* describe a picture packed contiguously in a buffer, with an optional luma row pitch */
+void picture_init(picture_t *pic, const unsigned char *buf, int width, int height, pixelformat_t pixelformat, int rowbytes=0);
+
+/* describe one field of a frame picture */
+picture_t picture_field(const picture_t *frame, bool bottom);
+
+/* number of threads used for slice-parallel conversion, 1 for the calling thread only */
+void convert_set_threads(int threads);
+
+/* restrict conversion to the row kernels of a named instruction set, null for the best available,
+ * returns -1 if the instruction set is not supported by this cpu */
+int convert_set_isa(const char *isa);
+
+void convert_yuv_uyvy(const picture_t *src, const picture_t *dst);
+void convert_yu20_v210(const picture_t *src, const picture_t *dst);
+void convert_i420_uyvy_lumaonly(const picture_t *src, const picture_t *dst);
+void convert_field_yuv_uyvy(const picture_t *top, const picture_t *bot, const picture_t *dst);
 
 #endif
@@ -24,12 +24,24 @@ dldecode::dldecode()
     /* debug */
     top_field_first = 1;
     blank_field = 0;
+    /* output */
+    rowbytes = 0;
+    nontemporal = false;
 }
 
 dldecode::~dldecode()
 {
 }
 
+picture_t dldecode::output_picture(unsigned char *buffer)
+{
+    /* 8-bit formats are displayed as uyvy, 10-bit as v210 */
+    picture_t pic;
+    picture_init(&pic, buffer, width, height, pixelformat_is_8bit(pixelformat)? UYVY : V210, rowbytes);
+    pic.nontemporal = nontemporal;
+    return pic;
+}
+
 int dldecode::attach(dlformat *f)
 {
     /* attach the input format */
@@ -95,6 +107,9 @@ int dlyuv::attach(dlformat *f)
     size = pixelformat_get_size(pixelformat, width, height);
     data = (unsigned char *) malloc(size);
 
+    /* read ahead in frames, rounded up to the block size for direct i/o */
+    format->set_readsize(size);
+
     /* calculate the number of frames in the input */
     maxframes = format->filesize() / size;
 
@@ -111,10 +126,21 @@ decode_t dlyuv::decode(unsigned char *uyvy, size_t uyvysize)
 {
     decode_t results = {0, 0};
 
+    /* start timer */
+    unsigned long long start = get_utime();
+
+    picture_t dst = output_picture(uyvy);
+
     if (pixelformat==UYVY) {
         /* read directly into frame */
-        if (format->read(uyvy, width*height*2)!=(size_t)(width*height*2))
-            dlerror("failed to read frame from input stream");
+        if (dst.stride[0]==width*2) {
+            if (format->read(uyvy, width*height*2)!=(size_t)(width*height*2))
+                dlerror("failed to read frame from input stream");
+        } else {
+            for (int y=0; y<height; y++)
+                if (format->read(uyvy+dst.stride[0]*y, width*2)!=(size_t)(width*2))
+                    dlerror("failed to read frame from input stream");
+        }
         results.size = width*height*2;
     } else {
         /* read frame from input */
@@ -124,14 +150,20 @@ decode_t dlyuv::decode(unsigned char *uyvy, size_t uyvysize)
             dlerror("failed to read frame from input stream");
         results.size = bytes;
 
+        /* timestamp read time */
+        unsigned long long decode = get_utime();
+        results.decode_time = decode - start;
+
         /* convert to uyvy */
-        if (!lumaonly) {
-            const unsigned char *yuv[3] = {data, data+width*height, (pixelformat==I444? data+2*width*height : pixelformat==I422? data+3*width*height/2 : data+5*width*height/4)};
-            convert_yuv_uyvy(yuv, uyvy, width, height, pixelformat);
-            //convert_i420_uyvy(data, uyvy, width, height, pixelformat);
-        } else
-            convert_i420_uyvy_lumaonly(data, uyvy, width, height);
+        picture_t src;
+        picture_init(&src, data, width, height, pixelformat);
+        if (!lumaonly)
+            convert_yuv_uyvy(&src, &dst);
+        else
+            convert_i420_uyvy_lumaonly(&src, &dst);
 
+        /* measure render time */
+        results.render_time = get_utime() - decode;
     }
 
     results.timestamp = timestamp;
@@ -150,6 +182,8 @@ dlmpeg2::dlmpeg2()
     mpeg2_accel(MPEG2_ACCEL_DETECT);
     /* don't assume timestamps start from zero */
     last_sts = -1;
+    spans = NULL;
+    num_spans = next_span = 0;
 }
 
 dlmpeg2::~dlmpeg2()
@@ -172,13 +206,20 @@ int dlmpeg2::attach(dlformat *f)
         mpeg2_state_t state = mpeg2_parse(mpeg2dec);
         switch (state) {
             case STATE_BUFFER:
-                /* read a chunk of data from input */
-                data = format->read(&read);
-                if (read>0) {
-                    /* tag with most recent available timestamp */
-                    sts_t sts = format->get_pts();
-                    mpeg2_tag_picture(mpeg2dec, (uint32_t)sts, uint32_t(sts>>32));
-                    mpeg2_buffer(mpeg2dec, (unsigned char *)data, (unsigned char *)data+read);
+                /* read a chunk of data from input, as spans without copying them together */
+                if (next_span==num_spans) {
+                    spans = format->read_spans(&num_spans, &read);
+                    next_span = 0;
+                    if (read>0) {
+                        /* tag with most recent available timestamp */
+                        sts_t sts = format->get_pts();
+                        mpeg2_tag_picture(mpeg2dec, (uint32_t)sts, uint32_t(sts>>32));
+                    }
+                }
+                if (next_span<num_spans) {
+                    data = spans[next_span].data;
+                    mpeg2_buffer(mpeg2dec, (unsigned char *)data, (unsigned char *)data+spans[next_span].size);
+                    next_span++;
                 }
                 break;
 
@@ -203,32 +244,48 @@ decode_t dlmpeg2::decode(unsigned char *uyvy, size_t uyvysize)
 {
     decode_t results = {0, -1ll, 0ll, 0ll};
 
+    /* start timer */
+    unsigned long long start = get_utime();
+
     const unsigned char *data;
     size_t read = 0;
     do {
         mpeg2_state_t state = mpeg2_parse(mpeg2dec);
         switch (state) {
             case STATE_BUFFER:
-                /* read a chunk of data from input */
-                data = format->read(&read);
-                if (read==0 || format->eof()) {
-                    results.size = 0;
-                    return results;
-                }
-                if (read>0) {
+                /* read a chunk of data from input, as spans without copying them together */
+                if (next_span==num_spans) {
+                    spans = format->read_spans(&num_spans, &read);
+                    next_span = 0;
+                    if (read==0 || format->eof()) {
+                        num_spans = 0;
+                        results.size = 0;
+                        return results;
+                    }
                     /* tag with most recent available timestamp */
                     sts_t sts = format->get_pts();
                     mpeg2_tag_picture(mpeg2dec, (uint32_t)sts, uint32_t(sts>>32));
-                    mpeg2_buffer(mpeg2dec, (unsigned char *)data, (unsigned char *)data+read);
-                } else
-                    return results;
+                }
+                data = spans[next_span].data;
+                mpeg2_buffer(mpeg2dec, (unsigned char *)data, (unsigned char *)data+spans[next_span].size);
+                next_span++;
                 break;
 
             case STATE_SLICE:
             case STATE_END:
                 if (info->display_fbuf) {
-                    const unsigned char *yuv[3] = {info->display_fbuf->buf[0], info->display_fbuf->buf[1], info->display_fbuf->buf[2]};
-                    convert_yuv_uyvy(yuv, uyvy, width, height, pixelformat);
+                    /* timestamp decode time */
+                    unsigned long long decode = get_utime();
+                    results.decode_time = decode - start;
+
+                    /* libmpeg2 frame buffers are packed to the coded width */
+                    picture_t src;
+                    picture_init(&src, NULL, width, height, pixelformat, info->sequence->width);
+                    for (int p=0; p<3; p++)
+                        src.data[p] = info->display_fbuf->buf[p];
+                    picture_t dst = output_picture(uyvy);
+                    convert_yuv_uyvy(&src, &dst);
+                    results.render_time = get_utime() - decode;
                     results.size = width*height*2;
                     sts_t sts = -1;
                     if (info->current_picture)
@@ -924,14 +981,13 @@ decode_t dlhevc::decode(unsigned char *uyvy, size_t uyvysize)
 
         /* extract data from available frame */
         if (image) {
-            int stride;
-
             /* copy frame to history buffer FIXME 4:2:0 only */
-            const unsigned char *yuv[3] = {NULL};
-            yuv[0] = de265_get_image_plane(image, 0, &stride);
-            yuv[1] = de265_get_image_plane(image, 1, &stride);
-            yuv[2] = de265_get_image_plane(image, 2, &stride);
-            convert_yuv_uyvy(yuv, uyvy, width, height, pixelformat);
+            picture_t src;
+            picture_init(&src, NULL, width, height, pixelformat);
+            for (int p=0; p<3; p++)
+                src.data[p] = (unsigned char *)de265_get_image_plane(image, p, &src.stride[p]);
+            picture_t dst = output_picture(uyvy);
+            convert_yuv_uyvy(&src, &dst);
             results.size = width*height*2;
             sts_t sts = 2*de265_get_image_PTS(image);
             if (sts<0 || sts<=last_sts) {
@@ -987,13 +1043,12 @@ decode_t dlhevc::decode(unsigned char *uyvy, size_t uyvysize)
 
             /* extract data from available frame */
             if (image) {
-                int stride;
-
-                /* copy frame to history buffer FIXME 4:2:0 only */
-                const unsigned char *yuv[3] = {NULL};
-                yuv[0] = de265_get_image_plane(image, 0, &stride);
-                yuv[1] = de265_get_image_plane(image, 1, &stride);
-                yuv[2] = de265_get_image_plane(image, 2, &stride);
+                /* copy field to history buffer FIXME 4:2:0 only */
+                picture_t src;
+                picture_init(&src, NULL, width, height/2, pixelformat);
+                for (int p=0; p<3; p++)
+                    src.data[p] = (unsigned char *)de265_get_image_plane(image, p, &src.stride[p]);
+                picture_t dst = output_picture(uyvy);
 
 #ifdef HAVE_LIBDE265_CUSTOM
                 /* get poc and field order info from decoder */
@@ -1029,11 +1084,13 @@ decode_t dlhevc::decode(unsigned char *uyvy, size_t uyvysize)
 
                 /* deinterlace */
                 if (top_field==top_field_first) {
-                    convert_top_field_yuv_uyvy(yuv, uyvy, width, height, pixelformat);
+                    src.picstruct = TOP_FIELD;
+                    convert_yuv_uyvy(&src, &dst);
                     /* move field on if it is the correct order */
                     field += (top_field_first ^ field);
                 } else if (top_field==!top_field_first) {
-                    convert_bot_field_yuv_uyvy(yuv, uyvy, width, height, pixelformat);
+                    src.picstruct = BOTTOM_FIELD;
+                    convert_yuv_uyvy(&src, &dst);
                     field += !(top_field_first ^ field);
                 }
 
@@ -1068,6 +1125,24 @@ decode_t dlhevc::decode(unsigned char *uyvy, size_t uyvysize)
 #endif
 
 #ifdef HAVE_FFMPEG
+/* describe a decoded frame, honouring the line padding of the decoder */
+static picture_t avframe_picture(const AVFrame *frame, pixelformat_t pixelformat)
+{
+    picture_t pic;
+    picture_init(&pic, NULL, frame->width, frame->height, pixelformat);
+    for (int p=0; p<3; p++) {
+        pic.data[p] = frame->data[p];
+        pic.stride[p] = frame->linesize[p];
+    }
+    if (pixelformat==P010 || pixelformat==P210) {
+        /* both chroma planes are the interleaved plane */
+        pic.data[2] = pic.data[1];
+        pic.stride[2] = pic.stride[1];
+    }
+    if (frame->chroma_location==AVCHROMA_LOC_CENTER)
+        pic.siting = SITING_CENTRE;
+    return pic;
+}
 dlffvideo::dlffvideo()
 {
     init();
@@ -1090,6 +1165,8 @@ void dlffvideo::init()
 {
     codeccontext = NULL;
     frame = NULL;
+    spans = NULL;
+    num_spans = next_span = 0;
     size = 0;
     ptr = NULL;
     got_frame = 0;
@@ -1150,14 +1227,22 @@ int dlffvideo::attach(dlformat* f)
     got_frame = 0;
     while (!got_frame) {
         if (size==0) {
-            const unsigned char *buf = format->read(&size);
-            if (size==0)
-                break;
-            ptr = buf;
+            /* the next span of the data, reading more as spans without copying them together */
+            if (next_span==num_spans) {
+                size_t bytes = 0;
+                spans = format->read_spans(&num_spans, &bytes);
+                next_span = 0;
+                if (bytes==0)
+                    break;
+            }
+            ptr = spans[next_span].data;
+            size = spans[next_span].size;
+            next_span++;
         }
 
-        /* use the parser to split the data into frames */
-        ret = av_parser_parse2(parser, codeccontext, &packet->data, &packet->size, ptr, size, format->get_pts(), format->get_dts(), 0);
+        /* use the parser to split the data into frames, the timestamps belong to the start of the data */
+        bool first = next_span==1;
+        ret = av_parser_parse2(parser, codeccontext, &packet->data, &packet->size, ptr, size, first? format->get_pts() : AV_NOPTS_VALUE, first? format->get_dts() : AV_NOPTS_VALUE, 0);
         if (ret < 0)
             dlexit("failed to parse %s data", avcodec_get_name(codecid));
         ptr += ret;
@@ -1195,6 +1280,10 @@ int dlffvideo::attach(dlformat* f)
         case AV_PIX_FMT_YUVJ422P : pixelformat = I422; break;
         case AV_PIX_FMT_YUV420P  :
         case AV_PIX_FMT_YUVJ420P : pixelformat = I420; break;
+        case AV_PIX_FMT_YUV422P10LE : pixelformat = YU20; break;
+        case AV_PIX_FMT_YUV420P10LE : pixelformat = YU15; break;
+        case AV_PIX_FMT_P210LE   : pixelformat = P210; break;
+        case AV_PIX_FMT_P010LE   : pixelformat = P010; break;
         //case AV_PIX_FMT_GRAY8    : pixelformat = Y800; break;
         default : dlexit("unknown chroma format: %s", av_get_pix_fmt_name(codeccontext->pix_fmt));
     }
@@ -1223,15 +1312,23 @@ decode_t dlffvideo::decode(unsigned char *uyvy, size_t uyvysize)
     /* decode the next avc frame */
     do {
         if (size==0) {
-            const unsigned char *buf = format->read(&size);
-            if (size==0)
-                break;
-            ptr = buf;
+            /* the next span of the data, reading more as spans without copying them together */
+            if (next_span==num_spans) {
+                size_t bytes = 0;
+                spans = format->read_spans(&num_spans, &bytes);
+                next_span = 0;
+                if (bytes==0)
+                    break;
+            }
+            ptr = spans[next_span].data;
+            size = spans[next_span].size;
+            next_span++;
         }
 
-        /* use the parser to split the data into frames */
+        /* use the parser to split the data into frames, the timestamps belong to the start of the data */
         if (!got_frame) {
-            ret = av_parser_parse2(parser, codeccontext, &packet->data, &packet->size, ptr, size, format->get_pts(), format->get_dts(), 0);
+            bool first = next_span==1;
+            ret = av_parser_parse2(parser, codeccontext, &packet->data, &packet->size, ptr, size, first? format->get_pts() : AV_NOPTS_VALUE, first? format->get_dts() : AV_NOPTS_VALUE, 0);
             if (ret < 0)
                 dlexit("failed to parse %s data", avcodec_get_name(codecid));
             ptr += ret;
@@ -1263,8 +1360,10 @@ decode_t dlffvideo::decode(unsigned char *uyvy, size_t uyvysize)
             unsigned long long decode = get_utime();
             results.decode_time = decode - start;
 
-            /* copy frame to uyvy buffer */
-            convert_yuv_uyvy((const unsigned char **)frame->data, uyvy, width, height, pixelformat);
+            /* convert frame in place to uyvy buffer */
+            picture_t src = avframe_picture(frame, pixelformat);
+            picture_t dst = output_picture(uyvy);
+            convert_yuv_uyvy(&src, &dst);
             results.size = width*height*2;
 
             /* get timestamp from decoder */
@@ -1360,6 +1459,10 @@ int dlffmpeg::attach(dlformat* f)
         case AV_PIX_FMT_YUVJ422P : pixelformat = I422; break;
         case AV_PIX_FMT_YUV420P  :
         case AV_PIX_FMT_YUVJ420P : pixelformat = I420; break;
+        case AV_PIX_FMT_YUV422P10LE : pixelformat = YU20; break;
+        case AV_PIX_FMT_YUV420P10LE : pixelformat = YU15; break;
+        case AV_PIX_FMT_P210LE   : pixelformat = P210; break;
+        case AV_PIX_FMT_P010LE   : pixelformat = P010; break;
         //case AV_PIX_FMT_GRAY8    : pixelformat = Y800; break;
         default : dlexit("unknown chroma format: %s", av_get_pix_fmt_name(codeccontext->pix_fmt));
     }
@@ -1442,8 +1545,10 @@ decode_t dlffmpeg::decode(unsigned char *uyvy, size_t uyvysize)
             unsigned long long decode = get_utime();
             results.decode_time = decode - start;
 
-            /* copy frame to uyvy buffer */
-            convert_yuv_uyvy((const unsigned char **)frame->data, uyvy, width, height, pixelformat);
+            /* convert frame in place to uyvy buffer */
+            picture_t src = avframe_picture(frame, pixelformat);
+            picture_t dst = output_picture(uyvy);
+            convert_yuv_uyvy(&src, &dst);
             results.size = width*height*2;
             /* get pts from decoder */
             sts_t sts = 2*frame->pts;
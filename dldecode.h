@@ -20,6 +20,7 @@ extern "C" {
 
 #include "dlutil.h"
 #include "dlformat.h"
+#include "dlconv.h"
 
 /* decoder data types */
 typedef struct {
@@ -44,7 +45,16 @@ public:
     /* verbose level */
     void set_verbose(int v) { verbose = v; }
 
+    /* row pitch of the output frame buffer, 0 for tightly packed */
+    void set_rowbytes(int r) { rowbytes = r; }
+
+    /* write the output frame buffer with non-temporal stores */
+    void set_nontemporal(bool n) { nontemporal = n; }
+
 protected:
+    /* describe the output frame buffer */
+    picture_t output_picture(unsigned char *buffer);
+
     /* data source */
     dlformat *format;
 
@@ -56,6 +66,10 @@ protected:
     /* verbose level */
     int verbose;
 
+    /* output frame buffer */
+    int rowbytes;
+    bool nontemporal;
+
 public: /* yes public, we're not designing a type library here */
     /* video parameters */
     int width;
@@ -126,6 +140,11 @@ protected:
     /* libmpeg2 variables */
     mpeg2dec_t *mpeg2dec;
     const mpeg2_info_t *info;
+
+    /* spans of the data read from input, passed to libmpeg2 in turn */
+    const span_t *spans;
+    int num_spans;
+    int next_span;
 };
 
 /* pcm class */
@@ -242,7 +261,10 @@ protected:
     AVFrame *frame;
     AVPacket *packet;
 
-    /* data buffer */
+    /* data buffer, the spans of the data read from input and the current span */
+    const span_t *spans;
+    int num_spans;
+    int next_span;
     size_t size;
     const unsigned char *ptr;
     int got_frame;
@@ -62,6 +62,14 @@ const unsigned char *dlformat::read(size_t *bytes)
     return data;
 }
 
+const span_t *dlformat::read_spans(int *count, size_t *bytes)
+{
+    span.data = read(bytes);
+    span.size = *bytes;
+    *count = *bytes? 1 : 0;
+    return &span;
+}
+
 long long dlformat::get_pts()
 {
     /* only implemented in sub-classes */
@@ -81,121 +89,60 @@ dltstream::dltstream(int p)
 {
     pid = p;
     pts = dts = -1ll;
-    packet = NULL;
-    packet_valid = false;
+    demux = NULL;
+    owner = false;
 }
 
 dltstream::~dltstream()
 {
-    if (packet)
-        free(packet);
+    if (owner)
+        delete demux;
 }
 
 int dltstream::attach(dlsource *s)
 {
-    /* attach the input source */
-    source = s;
-    token = source->attach();
-
-    /* allocate the packet buffer */
-    packet = (unsigned char *) malloc(188);
-    packet_valid = false;
+    /* read the source through a private demultiplexer */
+    owner = true;
+    return attach(new dltsdemux(s));
+}
 
-    /* allocate the pes buffer */
-    size = 64*1024;     /* arbitrary size to start with */
-    data = (unsigned char *) malloc(size);
+int dltstream::attach(dltsdemux *d)
+{
+    /* attach the demultiplexer and its source */
+    demux = d;
+    source = demux->source;
+    token = demux->token;
+    demux->add_pid(pid);
 
     return 0;
 }
 
+int dltstream::rewind(dltoken_t t)
+{
+    return demux->rewind();
+}
+
 size_t dltstream::read(unsigned char *buf, size_t bytes)
 {
     dlexit("dltstream::read() into external buffer is not supported");
     return 0;
 }
 
+/* read next whole pes packet with correct pid */
 const unsigned char *dltstream::read(size_t *bytes)
 {
-    size_t packet_size = 0;
-
-    /* default no pts */
-    pts = dts = -1ll;
+    return demux->read(pid, bytes, &pts, &dts);
+}
 
-    /* read next whole pes packet with correct pid */
-    int start = 1;
-    while (1) {
-        /* read next packet */
-        if (!packet_valid)
-            if (next_packet(packet, source, token)<0)
-                return 0;
-
-        /* check pid is correct */
-        int packet_pid = ((packet[1]<<8) | packet[2]) & 0x1fff;
-        if (packet_pid!=pid)
-            continue;
-
-        /* check start indicator */
-        int payload_unit_start_indicator = packet[1] & 0x40;
-        if (start && !payload_unit_start_indicator)
-            continue;   /* looking for start of next pes packet */
-        else if (start && payload_unit_start_indicator)
-            start = 0;  /* found start of next pes packet */
-        else if (!start && payload_unit_start_indicator) {
-            packet_valid = true;
-            break;      /* start of next pes packet i.e. end of this one */
-        }
-
-        /* skip transport packet header */
-        int ptr = 4;
-
-        /* skip adaption field */
-        int adaptation_field_control = (packet[3] >> 4) & 0x3;
-        if (adaptation_field_control==2 || adaptation_field_control==3)
-            ptr += 1 + packet[4];
-
-        /* skip pes header */
-        if (payload_unit_start_indicator) {
-            int packet_start_code_prefix = (packet[ptr]<<16) | (packet[ptr+1]<<8) | packet[ptr+2];
-            int stream_id = packet[ptr+3];
-            if (packet_start_code_prefix!=0x1)
-                dlexit("error parsing pes header, start_code=0x%06x stream_id=0x%02x", packet_start_code_prefix, stream_id);
-
-            /* look for pts and dts */
-            int pts_dts_flags = packet[ptr+7] >> 6;
-            if (pts_dts_flags==2 || pts_dts_flags==3) {
-                long long pts3 = (packet[ptr+9] >> 1) & 0x7;
-                long long pts2 = (packet[ptr+10] << 7 | (packet[ptr+11] >> 1));
-                long long pts1 = (packet[ptr+12] << 7 | (packet[ptr+13] >> 1));
-                    pts = (pts3<<30) | (pts2<<15) | pts1;
-            }
-            if (pts_dts_flags==3) {
-                long long dts3 = (packet[ptr+14] >> 1) & 0x7;
-                long long dts2 = (packet[ptr+15] << 7 | (packet[ptr+16] >> 1));
-                long long dts1 = (packet[ptr+17] << 7 | (packet[ptr+18] >> 1));
-                    dts = (dts3<<30) | (dts2<<15) | dts1;
-            }
-
-            int pes_header_data_length = packet[ptr+8];
-
-            ptr += 9 + pes_header_data_length;
-        }
-
-        /* resize data buffer if necessary */
-        if (packet_size+188-ptr>size) {
-            size += size;
-            data = (unsigned char *) realloc(data, size);
-            //dlmessage("reallocing data buffer to %zd bytes", size);
-        }
-
-        /* copy data */
-        memcpy(data+packet_size, packet+ptr, 188-ptr);
-        packet_size += 188-ptr;
-        packet_valid = false;
-    }
+/* read next whole pes packet as the spans of its payload in the transport packets */
+const span_t *dltstream::read_spans(int *count, size_t *bytes)
+{
+    return demux->read_spans(pid, count, bytes, &pts, &dts);
+}
 
-    //dlmessage("return pes packet of %zd bytes", packet_size);
-    *bytes = packet_size;
-    return data;
+bool dltstream::eof()
+{
+    return demux->eof(pid);
 }
 
 long long int dltstream::get_pts()
@@ -9,6 +9,8 @@ extern "C" {
 #endif
 }
 
+class dltsdemux;
+
 /* virtual base class for data format decoders */
 class dlformat
 {
@@ -24,6 +26,8 @@ public:
     virtual size_t read(unsigned char *buf, size_t bytes);
     /* zero copy read (depending on implementation) */
     virtual const unsigned char *read(size_t *bytes);
+    /* zero copy read as a list of spans, a single span unless the format has scattered data */
+    virtual const span_t *read_spans(int *count, size_t *bytes);
 
     /* return most recent timestamp */
     virtual long long get_pts();
@@ -36,6 +40,7 @@ public:
     virtual off_t pos() { return source->pos(token); }
     virtual bool eof() { return source->eof(token); }
     virtual bool error() { return source->error(token); }
+    virtual void set_readsize(size_t bytes) { source->set_readsize(bytes); }
 
     /* format metadata */
     virtual const char *description() { return "raw"; }
@@ -48,6 +53,7 @@ protected:
     /* buffer variables */
     size_t size;
     unsigned char *data;
+    span_t span;
 
 };
 
@@ -59,7 +65,8 @@ public:
     virtual const char *description() { return "elementary stream"; }
 };
 
-/* transport stream format decoder class */
+/* transport stream format decoder class, reads one pid through a demultiplexer
+ * which is either private or shared with the formats of the other pids */
 class dltstream : public dlformat
 {
 public:
@@ -67,25 +74,31 @@ public:
     virtual ~dltstream();
 
     /* format operators */
+    virtual int rewind(dltoken_t token=0);
     virtual int attach(dlsource *source);
+    int attach(dltsdemux *demux);
 
     /* copy to buffer read */
     virtual size_t read(unsigned char *buf, size_t bytes);
     /* zero copy read (depending on implementation) */
     virtual const unsigned char *read(size_t *bytes);
+    virtual const span_t *read_spans(int *count, size_t *bytes);
 
     /* return most recent pts */
     virtual long long get_pts();
     virtual long long get_dts();
 
+    /* expose source interfaces */
+    virtual bool eof();
+
     /* format metadata */
     virtual const char *description() { return "transport stream"; }
 
 protected:
     int pid;
     long long pts, dts;
-    unsigned char *packet;
-    bool packet_valid;
+    dltsdemux *demux;
+    bool owner;
 };
 
 #ifdef HAVE_FFMPEG
@@ -0,0 +1,861 @@
+/*
+ * Description: vectorised row conversion kernels with runtime cpu dispatch
+ * Author     : Ryan Dalzell
+ * Copyright  : (c) 2026 4i2i Communications Ltd.
+ */
+
+#include <string.h>
+
+#include "dlutil.h"
+#include "dlkernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86
+/* gcc warns about the deliberately undefined vectors inside the avx-512 intrinsics */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#endif
+
+/*
+ * 4:4:4 to 4:2:2 chroma decimation uses a [1 2 1]/4 filter centred on the
+ * even samples, so the output chroma stays co-sited with the even luma samples,
+ * the left edge is mirrored, the vector kernels are bit exact with the scalar one
+ */
+static inline unsigned char decimate(const unsigned char *c, int x, int width)
+{
+    int l = x>0? c[x-1] : c[x+1];
+    int r = x+1<width? c[x+1] : c[x-1];
+    return (l + 2*c[x] + r + 2) >> 2;
+}
+
+/* scalar reference kernel */
+static void row_444_uyvy_c(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int width)
+{
+    for (int x=0; x<width/2*2; x+=2) {
+        *(uyvy++) = decimate(u, x, width);
+        *(uyvy++) = y[x];
+        *(uyvy++) = decimate(v, x, width);
+        *(uyvy++) = y[x+1];
+    }
+}
+
+/* finish a row from a given luma position with the scalar kernel */
+static inline void row_444_uyvy_tail(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int x, int width)
+{
+    for (uyvy+=2*x; x<width/2*2; x+=2) {
+        *(uyvy++) = decimate(u, x, width);
+        *(uyvy++) = y[x];
+        *(uyvy++) = decimate(v, x, width);
+        *(uyvy++) = y[x+1];
+    }
+}
+
+/* scalar reference kernel */
+static void row_422_uyvy_c(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int width)
+{
+    for (int x=0; x<width/2; x++) {
+        *(uyvy++) = *(u++);
+        *(uyvy++) = *(y++);
+        *(uyvy++) = *(v++);
+        *(uyvy++) = *(y++);
+    }
+}
+
+/* bytes in a row of v210, which is padded to a multiple of 48 pixels */
+static inline int v210_rowbytes(int width)
+{
+    return ((width+47)/48)*128;
+}
+
+/* pack one row of v210 from a given luma position, a partial group at the end
+ * of the row is padded by repeating the last samples, then the row is zero filled */
+static void row_v210_tail(const uint16_t *y, const uint16_t *u, const uint16_t *v, unsigned char *v210, int x, int width)
+{
+    const int chroma_width = (width+1)/2;
+
+    uint32_t *w = (uint32_t *)(v210 + x/6*16);
+    for (; x<width; x+=6) {
+        uint32_t l[6], cb[3], cr[3];
+        for (int i=0; i<6; i++)
+            l[i] = y[mmin(x+i, width-1)] & 0x3ff;
+        for (int i=0; i<3; i++) {
+            cb[i] = u[mmin(x/2+i, chroma_width-1)] & 0x3ff;
+            cr[i] = v[mmin(x/2+i, chroma_width-1)] & 0x3ff;
+        }
+        *(w++) = cr[0]<<20 | l[0]<<10  | cb[0];
+        *(w++) = l[2]<<20  | cb[1]<<10 | l[1];
+        *(w++) = cb[2]<<20 | l[3]<<10  | cr[1];
+        *(w++) = l[5]<<20  | cr[2]<<10 | l[4];
+    }
+
+    unsigned char *end = v210 + v210_rowbytes(width);
+    memset(w, 0, end-(unsigned char *)w);
+}
+
+/* scalar reference kernel */
+static void row_v210_c(const uint16_t *y0, const uint16_t *y1, const uint16_t *u, const uint16_t *v, unsigned char *v210_0, unsigned char *v210_1, int width)
+{
+    row_v210_tail(y0, u, v, v210_0, 0, width);
+    if (y1)
+        row_v210_tail(y1, u, v, v210_1, 0, width);
+}
+
+/* as row_v210_tail for msb aligned samples with interleaved chroma */
+static void row_p210_tail(const uint16_t *y, const uint16_t *uv, unsigned char *v210, int x, int width)
+{
+    const int chroma_width = (width+1)/2;
+
+    uint32_t *w = (uint32_t *)(v210 + x/6*16);
+    for (; x<width; x+=6) {
+        uint32_t l[6], cb[3], cr[3];
+        for (int i=0; i<6; i++)
+            l[i] = y[mmin(x+i, width-1)] >> 6;
+        for (int i=0; i<3; i++) {
+            cb[i] = uv[2*mmin(x/2+i, chroma_width-1)+0] >> 6;
+            cr[i] = uv[2*mmin(x/2+i, chroma_width-1)+1] >> 6;
+        }
+        *(w++) = cr[0]<<20 | l[0]<<10  | cb[0];
+        *(w++) = l[2]<<20  | cb[1]<<10 | l[1];
+        *(w++) = cb[2]<<20 | l[3]<<10  | cr[1];
+        *(w++) = l[5]<<20  | cr[2]<<10 | l[4];
+    }
+
+    unsigned char *end = v210 + v210_rowbytes(width);
+    memset(w, 0, end-(unsigned char *)w);
+}
+
+/* scalar reference kernel */
+static void row_p210_v210_c(const uint16_t *y0, const uint16_t *y1, const uint16_t *uv, unsigned char *v210_0, unsigned char *v210_1, int width)
+{
+    row_p210_tail(y0, uv, v210_0, 0, width);
+    if (y1)
+        row_p210_tail(y1, uv, v210_1, 0, width);
+}
+
+/* scalar reference kernel, a word at a time */
+static void xor_block_c(unsigned char *dst, const unsigned char *src, int bytes)
+{
+    int i;
+    for (i=0; i+8<=bytes; i+=8) {
+        uint64_t d, s;
+        memcpy(&d, dst+i, 8);
+        memcpy(&s, src+i, 8);
+        d ^= s;
+        memcpy(dst+i, &d, 8);
+    }
+    for (; i<bytes; i++)
+        dst[i] ^= src[i];
+}
+
+/* transport stream packets and the number of following packets which must also start with a sync byte */
+#define TS_PACKET 188
+#define TS_SYNC 0x47
+#define SYNC_LOOKAHEAD 2
+
+static inline bool sync_at(const unsigned char *data, int i, int bytes)
+{
+    for (int k=0; k<=SYNC_LOOKAHEAD && i+k*TS_PACKET<bytes; k++)
+        if (data[i+k*TS_PACKET]!=TS_SYNC)
+            return false;
+    return true;
+}
+
+/* scalar reference kernel */
+static int find_sync_c(const unsigned char *data, int bytes)
+{
+    for (int i=0; i<bytes; i++)
+        if (sync_at(data, i, bytes))
+            return i;
+    return -1;
+}
+
+/* the end of the block where the lookahead runs out */
+static int find_sync_tail(const unsigned char *data, int i, int bytes)
+{
+    for (; i<bytes; i++)
+        if (sync_at(data, i, bytes))
+            return i;
+    return -1;
+}
+
+#ifdef HAVE_X86
+/*
+ * the _nt instantiations of the kernels write with non-temporal stores, for
+ * destinations such as dma buffers that are not read again by the cpu, they
+ * need an aligned destination row and fall back to ordinary stores otherwise,
+ * and they prefetch the planar source ahead of the loads
+ */
+#define PREFETCH_DISTANCE 512
+
+static inline bool is_aligned(const void *p, uintptr_t alignment)
+{
+    return ((uintptr_t)p & (alignment-1))==0;
+}
+
+template <bool NT>
+__attribute__((target("sse2")))
+static inline void store_sse2(void *p, __m128i v)
+{
+    if (NT)
+        _mm_stream_si128((__m128i *)p, v);
+    else
+        _mm_storeu_si128((__m128i *)p, v);
+}
+
+template <bool NT>
+__attribute__((target("avx2")))
+static inline void store_avx2(void *p, __m256i v)
+{
+    if (NT)
+        _mm256_stream_si256((__m256i *)p, v);
+    else
+        _mm256_storeu_si256((__m256i *)p, v);
+}
+
+template <bool NT>
+__attribute__((target("avx512f")))
+static inline void store_avx512(void *p, __m512i v)
+{
+    if (NT)
+        _mm512_stream_si512((__m512i *)p, v);
+    else
+        _mm512_storeu_si512(p, v);
+}
+
+template <bool NT>
+static inline void prefetch(const void *p)
+{
+    if (NT)
+        _mm_prefetch((const char *)p + PREFETCH_DISTANCE, _MM_HINT_NTA);
+}
+
+/* filter 16 chroma samples to 8 co-sited samples in 16-bit lanes */
+__attribute__((target("sse2")))
+static inline __m128i decimate_sse2(const unsigned char *c)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    __m128i cur = _mm_loadu_si128((const __m128i *)c);
+    __m128i prv = _mm_loadu_si128((const __m128i *)(c-1));
+    __m128i e = _mm_and_si128(cur, mask);
+    __m128i o = _mm_srli_epi16(cur, 8);
+    __m128i p = _mm_and_si128(prv, mask);
+    __m128i s = _mm_add_epi16(_mm_add_epi16(p, o), _mm_add_epi16(e, e));
+    return _mm_srli_epi16(_mm_add_epi16(s, _mm_set1_epi16(2)), 2);
+}
+
+template <bool NT>
+__attribute__((target("sse2")))
+static void row_444_uyvy_sse2(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int width)
+{
+    if (NT && !is_aligned(uyvy, 16))
+        return row_444_uyvy_sse2<false>(y, u, v, uyvy, width);
+
+    /* the first pair needs the mirrored left edge, streaming starts on an aligned store */
+    const int start = NT? 8 : 2;
+    row_444_uyvy_tail(y, u, v, uyvy, 0, mmin(start, width));
+
+    int x;
+    for (x=start; x+16<=width; x+=16) {
+        prefetch<NT>(y+x);
+        prefetch<NT>(u+x);
+        prefetch<NT>(v+x);
+        __m128i uv = _mm_packus_epi16(decimate_sse2(u+x), decimate_sse2(v+x));
+        uv = _mm_unpacklo_epi8(uv, _mm_srli_si128(uv, 8));
+        __m128i l = _mm_loadu_si128((const __m128i *)(y+x));
+        store_sse2<NT>(uyvy+2*x+ 0, _mm_unpacklo_epi8(uv, l));
+        store_sse2<NT>(uyvy+2*x+16, _mm_unpackhi_epi8(uv, l));
+    }
+
+    row_444_uyvy_tail(y, u, v, uyvy, x, width);
+    if (NT)
+        _mm_sfence();
+}
+
+template <bool NT>
+__attribute__((target("sse2")))
+static void row_422_uyvy_sse2(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int width)
+{
+    if (NT && !is_aligned(uyvy, 16))
+        return row_422_uyvy_sse2<false>(y, u, v, uyvy, width);
+
+    int x;
+    for (x=0; x+16<=width; x+=16) {
+        prefetch<NT>(y+x);
+        prefetch<NT>(u+x/2);
+        prefetch<NT>(v+x/2);
+        __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u+x/2)), _mm_loadl_epi64((const __m128i *)(v+x/2)));
+        __m128i l = _mm_loadu_si128((const __m128i *)(y+x));
+        store_sse2<NT>(uyvy+2*x+ 0, _mm_unpacklo_epi8(uv, l));
+        store_sse2<NT>(uyvy+2*x+16, _mm_unpackhi_epi8(uv, l));
+    }
+
+    row_422_uyvy_c(y+x, u+x/2, v+x/2, uyvy+2*x, width-x);
+    if (NT)
+        _mm_sfence();
+}
+
+__attribute__((target("avx2")))
+static inline __m256i decimate_avx2(const unsigned char *c)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    __m256i cur = _mm256_loadu_si256((const __m256i *)c);
+    __m256i prv = _mm256_loadu_si256((const __m256i *)(c-1));
+    __m256i e = _mm256_and_si256(cur, mask);
+    __m256i o = _mm256_srli_epi16(cur, 8);
+    __m256i p = _mm256_and_si256(prv, mask);
+    __m256i s = _mm256_add_epi16(_mm256_add_epi16(p, o), _mm256_add_epi16(e, e));
+    return _mm256_srli_epi16(_mm256_add_epi16(s, _mm256_set1_epi16(2)), 2);
+}
+
+template <bool NT>
+__attribute__((target("avx2")))
+static void row_444_uyvy_avx2(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int width)
+{
+    if (NT && !is_aligned(uyvy, 32))
+        return row_444_uyvy_avx2<false>(y, u, v, uyvy, width);
+
+    const int start = NT? 16 : 2;
+    row_444_uyvy_tail(y, u, v, uyvy, 0, mmin(start, width));
+
+    int x;
+    for (x=start; x+32<=width; x+=32) {
+        prefetch<NT>(y+x);
+        prefetch<NT>(u+x);
+        prefetch<NT>(v+x);
+        /* packing and interleaving are within 128-bit lanes */
+        __m256i uv = _mm256_packus_epi16(decimate_avx2(u+x), decimate_avx2(v+x));
+        uv = _mm256_unpacklo_epi8(uv, _mm256_bsrli_epi128(uv, 8));
+        __m256i l = _mm256_loadu_si256((const __m256i *)(y+x));
+        __m256i lo = _mm256_unpacklo_epi8(uv, l);
+        __m256i hi = _mm256_unpackhi_epi8(uv, l);
+        store_avx2<NT>(uyvy+2*x+ 0, _mm256_permute2x128_si256(lo, hi, 0x20));
+        store_avx2<NT>(uyvy+2*x+32, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    row_444_uyvy_tail(y, u, v, uyvy, x, width);
+    if (NT)
+        _mm_sfence();
+}
+
+template <bool NT>
+__attribute__((target("avx2")))
+static void row_422_uyvy_avx2(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int width)
+{
+    if (NT && !is_aligned(uyvy, 32))
+        return row_422_uyvy_avx2<false>(y, u, v, uyvy, width);
+
+    int x;
+    for (x=0; x+32<=width; x+=32) {
+        prefetch<NT>(y+x);
+        prefetch<NT>(u+x/2);
+        prefetch<NT>(v+x/2);
+        __m128i cb = _mm_loadu_si128((const __m128i *)(u+x/2));
+        __m128i cr = _mm_loadu_si128((const __m128i *)(v+x/2));
+        __m256i uv = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(cb, cr)), _mm_unpackhi_epi8(cb, cr), 1);
+        __m256i l = _mm256_loadu_si256((const __m256i *)(y+x));
+        __m256i lo = _mm256_unpacklo_epi8(uv, l);
+        __m256i hi = _mm256_unpackhi_epi8(uv, l);
+        store_avx2<NT>(uyvy+2*x+ 0, _mm256_permute2x128_si256(lo, hi, 0x20));
+        store_avx2<NT>(uyvy+2*x+32, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    row_422_uyvy_c(y+x, u+x/2, v+x/2, uyvy+2*x, width-x);
+    if (NT)
+        _mm_sfence();
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i decimate_avx512(const unsigned char *c)
+{
+    const __m512i mask = _mm512_set1_epi16(0x00ff);
+    __m512i cur = _mm512_loadu_si512((const void *)c);
+    __m512i prv = _mm512_loadu_si512((const void *)(c-1));
+    __m512i e = _mm512_and_si512(cur, mask);
+    __m512i o = _mm512_srli_epi16(cur, 8);
+    __m512i p = _mm512_and_si512(prv, mask);
+    __m512i s = _mm512_add_epi16(_mm512_add_epi16(p, o), _mm512_add_epi16(e, e));
+    return _mm512_srli_epi16(_mm512_add_epi16(s, _mm512_set1_epi16(2)), 2);
+}
+
+template <bool NT>
+__attribute__((target("avx512f,avx512bw")))
+static void row_444_uyvy_avx512(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int width)
+{
+    const __m512i first  = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+    const __m512i second = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+
+    if (NT && !is_aligned(uyvy, 64))
+        return row_444_uyvy_avx512<false>(y, u, v, uyvy, width);
+
+    const int start = NT? 32 : 2;
+    row_444_uyvy_tail(y, u, v, uyvy, 0, mmin(start, width));
+
+    int x;
+    for (x=start; x+64<=width; x+=64) {
+        prefetch<NT>(y+x);
+        prefetch<NT>(u+x);
+        prefetch<NT>(v+x);
+        __m512i uv = _mm512_packus_epi16(decimate_avx512(u+x), decimate_avx512(v+x));
+        uv = _mm512_unpacklo_epi8(uv, _mm512_bsrli_epi128(uv, 8));
+        __m512i l = _mm512_loadu_si512((const void *)(y+x));
+        __m512i lo = _mm512_unpacklo_epi8(uv, l);
+        __m512i hi = _mm512_unpackhi_epi8(uv, l);
+        store_avx512<NT>(uyvy+2*x+ 0, _mm512_permutex2var_epi64(lo, first, hi));
+        store_avx512<NT>(uyvy+2*x+64, _mm512_permutex2var_epi64(lo, second, hi));
+    }
+
+    row_444_uyvy_tail(y, u, v, uyvy, x, width);
+    if (NT)
+        _mm_sfence();
+}
+
+/*
+ * v210 packing shuffles each 10-bit sample into its 32-bit word, one shuffle
+ * for each of the three sample slots in a word, luma and chroma fill
+ * complementary slots so they are packed separately and combined with an or,
+ * which lets two rows of 4:2:0 luma share the packed chroma
+ *
+ *   word 0: cr0 y0  cb0
+ *   word 1: y2  cb1 y1
+ *   word 2: cb2 y3  cr1
+ *   word 3: y5  cr2 y4
+ */
+#define Z -128
+#define V210_LUMA_SLOTS \
+    _mm_setr_epi8(Z,Z,Z,Z, 2,3,Z,Z, Z,Z,Z,Z,  8, 9,Z,Z), \
+    _mm_setr_epi8(0,1,Z,Z, Z,Z,Z,Z, 6,7,Z,Z,  Z, Z,Z,Z), \
+    _mm_setr_epi8(Z,Z,Z,Z, 4,5,Z,Z, Z,Z,Z,Z, 10,11,Z,Z)
+#define V210_CHROMA_SLOTS \
+    _mm_setr_epi8(0,1,Z,Z, Z,Z,Z,Z, 10,11,Z,Z, Z, Z,Z,Z), \
+    _mm_setr_epi8(Z,Z,Z,Z, 2,3,Z,Z,  Z, Z,Z,Z, 12,13,Z,Z), \
+    _mm_setr_epi8(8,9,Z,Z, Z,Z,Z,Z,  4, 5,Z,Z, Z, Z,Z,Z)
+/* the same for chroma interleaved as cb0 cr0 cb1 cr1 cb2 cr2 in bytes 0-11 */
+#define V210_UV_SLOTS \
+    _mm_setr_epi8(0,1,Z,Z, Z,Z,Z,Z, 6,7,Z,Z,  Z, Z,Z,Z), \
+    _mm_setr_epi8(Z,Z,Z,Z, 4,5,Z,Z, Z,Z,Z,Z, 10,11,Z,Z), \
+    _mm_setr_epi8(2,3,Z,Z, Z,Z,Z,Z, 8,9,Z,Z,  Z, Z,Z,Z)
+
+/* pack one group of 6 pixels per 128-bit lane, luma samples in bytes 0-11
+ * and chroma samples in bytes 0-5 (cb) and 8-13 (cr) */
+__attribute__((target("ssse3")))
+static inline __m128i pack_v210_ssse3(__m128i s, const __m128i slot[3])
+{
+    s = _mm_and_si128(s, _mm_set1_epi16(0x3ff));
+    __m128i w = _mm_shuffle_epi8(s, slot[0]);
+    w = _mm_or_si128(w, _mm_slli_epi32(_mm_shuffle_epi8(s, slot[1]), 10));
+    return _mm_or_si128(w, _mm_slli_epi32(_mm_shuffle_epi8(s, slot[2]), 20));
+}
+
+template <bool NT>
+__attribute__((target("ssse3")))
+static void row_v210_ssse3(const uint16_t *y0, const uint16_t *y1, const uint16_t *u, const uint16_t *v, unsigned char *v210_0, unsigned char *v210_1, int width)
+{
+    const __m128i luma[3] = { V210_LUMA_SLOTS };
+    const __m128i chroma[3] = { V210_CHROMA_SLOTS };
+
+    if (NT && (!is_aligned(v210_0, 16) || (y1 && !is_aligned(v210_1, 16))))
+        return row_v210_ssse3<false>(y0, y1, u, v, v210_0, v210_1, width);
+
+    int x;
+    for (x=0; x+8<=width; x+=6) {
+        prefetch<NT>(y0+x);
+        prefetch<NT>(u+x/2);
+        prefetch<NT>(v+x/2);
+        __m128i c = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(u+x/2)), _mm_loadl_epi64((const __m128i *)(v+x/2)));
+        c = pack_v210_ssse3(c, chroma);
+        __m128i l = pack_v210_ssse3(_mm_loadu_si128((const __m128i *)(y0+x)), luma);
+        store_sse2<NT>(v210_0+x/6*16, _mm_or_si128(c, l));
+        if (y1) {
+            prefetch<NT>(y1+x);
+            l = pack_v210_ssse3(_mm_loadu_si128((const __m128i *)(y1+x)), luma);
+            store_sse2<NT>(v210_1+x/6*16, _mm_or_si128(c, l));
+        }
+    }
+
+    row_v210_tail(y0, u, v, v210_0, x, width);
+    if (y1)
+        row_v210_tail(y1, u, v, v210_1, x, width);
+    if (NT)
+        _mm_sfence();
+}
+
+/* semi-planar samples are msb aligned, so shift down before packing */
+template <bool NT>
+__attribute__((target("ssse3")))
+static void row_p210_v210_ssse3(const uint16_t *y0, const uint16_t *y1, const uint16_t *uv, unsigned char *v210_0, unsigned char *v210_1, int width)
+{
+    const __m128i luma[3] = { V210_LUMA_SLOTS };
+    const __m128i chroma[3] = { V210_UV_SLOTS };
+
+    if (NT && (!is_aligned(v210_0, 16) || (y1 && !is_aligned(v210_1, 16))))
+        return row_p210_v210_ssse3<false>(y0, y1, uv, v210_0, v210_1, width);
+
+    int x;
+    for (x=0; x+8<=width; x+=6) {
+        prefetch<NT>(y0+x);
+        prefetch<NT>(uv+x);
+        __m128i c = pack_v210_ssse3(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)(uv+x)), 6), chroma);
+        __m128i l = pack_v210_ssse3(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)(y0+x)), 6), luma);
+        store_sse2<NT>(v210_0+x/6*16, _mm_or_si128(c, l));
+        if (y1) {
+            prefetch<NT>(y1+x);
+            l = pack_v210_ssse3(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)(y1+x)), 6), luma);
+            store_sse2<NT>(v210_1+x/6*16, _mm_or_si128(c, l));
+        }
+    }
+
+    row_p210_tail(y0, uv, v210_0, x, width);
+    if (y1)
+        row_p210_tail(y1, uv, v210_1, x, width);
+    if (NT)
+        _mm_sfence();
+}
+
+__attribute__((target("avx2")))
+static inline __m256i pack_v210_avx2(__m256i s, const __m256i slot[3])
+{
+    s = _mm256_and_si256(s, _mm256_set1_epi16(0x3ff));
+    __m256i w = _mm256_shuffle_epi8(s, slot[0]);
+    w = _mm256_or_si256(w, _mm256_slli_epi32(_mm256_shuffle_epi8(s, slot[1]), 10));
+    return _mm256_or_si256(w, _mm256_slli_epi32(_mm256_shuffle_epi8(s, slot[2]), 20));
+}
+
+/* load two groups, one in each 128-bit lane */
+__attribute__((target("avx2")))
+static inline __m256i load_v210_luma_avx2(const uint16_t *y)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)y)), _mm_loadu_si128((const __m128i *)(y+6)), 1);
+}
+
+template <bool NT>
+__attribute__((target("avx2")))
+static void row_v210_avx2(const uint16_t *y0, const uint16_t *y1, const uint16_t *u, const uint16_t *v, unsigned char *v210_0, unsigned char *v210_1, int width)
+{
+    const __m128i luma128[3] = { V210_LUMA_SLOTS };
+    const __m128i chroma128[3] = { V210_CHROMA_SLOTS };
+    __m256i luma[3], chroma[3];
+    for (int i=0; i<3; i++) {
+        luma[i] = _mm256_broadcastsi128_si256(luma128[i]);
+        chroma[i] = _mm256_broadcastsi128_si256(chroma128[i]);
+    }
+
+    if (NT && (!is_aligned(v210_0, 32) || (y1 && !is_aligned(v210_1, 32))))
+        return row_v210_avx2<false>(y0, y1, u, v, v210_0, v210_1, width);
+
+    int x;
+    for (x=0; x+16<=width; x+=12) {
+        prefetch<NT>(y0+x);
+        prefetch<NT>(u+x/2);
+        prefetch<NT>(v+x/2);
+        __m128i c0 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(u+x/2+0)), _mm_loadl_epi64((const __m128i *)(v+x/2+0)));
+        __m128i c1 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(u+x/2+3)), _mm_loadl_epi64((const __m128i *)(v+x/2+3)));
+        __m256i c = pack_v210_avx2(_mm256_inserti128_si256(_mm256_castsi128_si256(c0), c1, 1), chroma);
+        __m256i l = pack_v210_avx2(load_v210_luma_avx2(y0+x), luma);
+        store_avx2<NT>(v210_0+x/6*16, _mm256_or_si256(c, l));
+        if (y1) {
+            prefetch<NT>(y1+x);
+            l = pack_v210_avx2(load_v210_luma_avx2(y1+x), luma);
+            store_avx2<NT>(v210_1+x/6*16, _mm256_or_si256(c, l));
+        }
+    }
+
+    row_v210_tail(y0, u, v, v210_0, x, width);
+    if (y1)
+        row_v210_tail(y1, u, v, v210_1, x, width);
+    if (NT)
+        _mm_sfence();
+}
+
+/* interleaved chroma of a group is laid out as its luma, so loads the same way */
+template <bool NT>
+__attribute__((target("avx2")))
+static void row_p210_v210_avx2(const uint16_t *y0, const uint16_t *y1, const uint16_t *uv, unsigned char *v210_0, unsigned char *v210_1, int width)
+{
+    const __m128i luma128[3] = { V210_LUMA_SLOTS };
+    const __m128i chroma128[3] = { V210_UV_SLOTS };
+    __m256i luma[3], chroma[3];
+    for (int i=0; i<3; i++) {
+        luma[i] = _mm256_broadcastsi128_si256(luma128[i]);
+        chroma[i] = _mm256_broadcastsi128_si256(chroma128[i]);
+    }
+
+    if (NT && (!is_aligned(v210_0, 32) || (y1 && !is_aligned(v210_1, 32))))
+        return row_p210_v210_avx2<false>(y0, y1, uv, v210_0, v210_1, width);
+
+    int x;
+    for (x=0; x+16<=width; x+=12) {
+        prefetch<NT>(y0+x);
+        prefetch<NT>(uv+x);
+        __m256i c = pack_v210_avx2(_mm256_srli_epi16(load_v210_luma_avx2(uv+x), 6), chroma);
+        __m256i l = pack_v210_avx2(_mm256_srli_epi16(load_v210_luma_avx2(y0+x), 6), luma);
+        store_avx2<NT>(v210_0+x/6*16, _mm256_or_si256(c, l));
+        if (y1) {
+            prefetch<NT>(y1+x);
+            l = pack_v210_avx2(_mm256_srli_epi16(load_v210_luma_avx2(y1+x), 6), luma);
+            store_avx2<NT>(v210_1+x/6*16, _mm256_or_si256(c, l));
+        }
+    }
+
+    row_p210_tail(y0, uv, v210_0, x, width);
+    if (y1)
+        row_p210_tail(y1, uv, v210_1, x, width);
+    if (NT)
+        _mm_sfence();
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i pack_v210_avx512(__m512i s, const __m512i slot[3])
+{
+    s = _mm512_and_si512(s, _mm512_set1_epi16(0x3ff));
+    __m512i w = _mm512_shuffle_epi8(s, slot[0]);
+    w = _mm512_or_si512(w, _mm512_slli_epi32(_mm512_shuffle_epi8(s, slot[1]), 10));
+    return _mm512_or_si512(w, _mm512_slli_epi32(_mm512_shuffle_epi8(s, slot[2]), 20));
+}
+
+/* load four groups, one in each 128-bit lane */
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i load_v210_luma_avx512(const uint16_t *y)
+{
+    __m512i l = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)y));
+    l = _mm512_inserti32x4(l, _mm_loadu_si128((const __m128i *)(y+ 6)), 1);
+    l = _mm512_inserti32x4(l, _mm_loadu_si128((const __m128i *)(y+12)), 2);
+    return _mm512_inserti32x4(l, _mm_loadu_si128((const __m128i *)(y+18)), 3);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m128i load_v210_chroma_sse2(const uint16_t *u, const uint16_t *v)
+{
+    return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)u), _mm_loadl_epi64((const __m128i *)v));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i load_v210_chroma_avx512(const uint16_t *u, const uint16_t *v)
+{
+    __m512i c = _mm512_castsi128_si512(load_v210_chroma_sse2(u, v));
+    c = _mm512_inserti32x4(c, load_v210_chroma_sse2(u+3, v+3), 1);
+    c = _mm512_inserti32x4(c, load_v210_chroma_sse2(u+6, v+6), 2);
+    return _mm512_inserti32x4(c, load_v210_chroma_sse2(u+9, v+9), 3);
+}
+
+template <bool NT>
+__attribute__((target("avx512f,avx512bw")))
+static void row_v210_avx512(const uint16_t *y0, const uint16_t *y1, const uint16_t *u, const uint16_t *v, unsigned char *v210_0, unsigned char *v210_1, int width)
+{
+    const __m128i luma128[3] = { V210_LUMA_SLOTS };
+    const __m128i chroma128[3] = { V210_CHROMA_SLOTS };
+    __m512i luma[3], chroma[3];
+    for (int i=0; i<3; i++) {
+        luma[i] = _mm512_broadcast_i32x4(luma128[i]);
+        chroma[i] = _mm512_broadcast_i32x4(chroma128[i]);
+    }
+
+    if (NT && (!is_aligned(v210_0, 64) || (y1 && !is_aligned(v210_1, 64))))
+        return row_v210_avx512<false>(y0, y1, u, v, v210_0, v210_1, width);
+
+    int x;
+    for (x=0; x+28<=width; x+=24) {
+        prefetch<NT>(y0+x);
+        prefetch<NT>(u+x/2);
+        prefetch<NT>(v+x/2);
+        __m512i c = pack_v210_avx512(load_v210_chroma_avx512(u+x/2, v+x/2), chroma);
+        __m512i l = pack_v210_avx512(load_v210_luma_avx512(y0+x), luma);
+        store_avx512<NT>(v210_0+x/6*16, _mm512_or_si512(c, l));
+        if (y1) {
+            prefetch<NT>(y1+x);
+            l = pack_v210_avx512(load_v210_luma_avx512(y1+x), luma);
+            store_avx512<NT>(v210_1+x/6*16, _mm512_or_si512(c, l));
+        }
+    }
+
+    row_v210_tail(y0, u, v, v210_0, x, width);
+    if (y1)
+        row_v210_tail(y1, u, v, v210_1, x, width);
+    if (NT)
+        _mm_sfence();
+}
+
+template <bool NT>
+__attribute__((target("avx512f,avx512bw")))
+static void row_p210_v210_avx512(const uint16_t *y0, const uint16_t *y1, const uint16_t *uv, unsigned char *v210_0, unsigned char *v210_1, int width)
+{
+    const __m128i luma128[3] = { V210_LUMA_SLOTS };
+    const __m128i chroma128[3] = { V210_UV_SLOTS };
+    __m512i luma[3], chroma[3];
+    for (int i=0; i<3; i++) {
+        luma[i] = _mm512_broadcast_i32x4(luma128[i]);
+        chroma[i] = _mm512_broadcast_i32x4(chroma128[i]);
+    }
+
+    if (NT && (!is_aligned(v210_0, 64) || (y1 && !is_aligned(v210_1, 64))))
+        return row_p210_v210_avx512<false>(y0, y1, uv, v210_0, v210_1, width);
+
+    int x;
+    for (x=0; x+28<=width; x+=24) {
+        prefetch<NT>(y0+x);
+        prefetch<NT>(uv+x);
+        __m512i c = pack_v210_avx512(_mm512_srli_epi16(load_v210_luma_avx512(uv+x), 6), chroma);
+        __m512i l = pack_v210_avx512(_mm512_srli_epi16(load_v210_luma_avx512(y0+x), 6), luma);
+        store_avx512<NT>(v210_0+x/6*16, _mm512_or_si512(c, l));
+        if (y1) {
+            prefetch<NT>(y1+x);
+            l = pack_v210_avx512(_mm512_srli_epi16(load_v210_luma_avx512(y1+x), 6), luma);
+            store_avx512<NT>(v210_1+x/6*16, _mm512_or_si512(c, l));
+        }
+    }
+
+    row_p210_tail(y0, uv, v210_0, x, width);
+    if (y1)
+        row_p210_tail(y1, uv, v210_1, x, width);
+    if (NT)
+        _mm_sfence();
+}
+#undef Z
+
+/* the xor kernels combine forward error correction packets, a few hundred
+ * bytes to a couple of kilobytes, so there is no streaming variant */
+__attribute__((target("sse2")))
+static void xor_block_sse2(unsigned char *dst, const unsigned char *src, int bytes)
+{
+    int i;
+    for (i=0; i+16<=bytes; i+=16) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst+i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(src+i));
+        _mm_storeu_si128((__m128i *)(dst+i), _mm_xor_si128(d, s));
+    }
+    xor_block_c(dst+i, src+i, bytes-i);
+}
+
+__attribute__((target("avx2")))
+static void xor_block_avx2(unsigned char *dst, const unsigned char *src, int bytes)
+{
+    int i;
+    for (i=0; i+32<=bytes; i+=32) {
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst+i));
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src+i));
+        _mm256_storeu_si256((__m256i *)(dst+i), _mm256_xor_si256(d, s));
+    }
+    xor_block_sse2(dst+i, src+i, bytes-i);
+}
+
+__attribute__((target("avx512f")))
+static void xor_block_avx512(unsigned char *dst, const unsigned char *src, int bytes)
+{
+    int i;
+    for (i=0; i+64<=bytes; i+=64) {
+        __m512i d = _mm512_loadu_si512(dst+i);
+        __m512i s = _mm512_loadu_si512(src+i);
+        _mm512_storeu_si512(dst+i, _mm512_xor_si512(d, s));
+    }
+    xor_block_avx2(dst+i, src+i, bytes-i);
+}
+
+/* the sync kernels compare a vector of candidate positions with the positions one and two packets on */
+__attribute__((target("sse2")))
+static int find_sync_sse2(const unsigned char *data, int bytes)
+{
+    const __m128i sync = _mm_set1_epi8(TS_SYNC);
+    int i;
+    for (i=0; i+SYNC_LOOKAHEAD*TS_PACKET+16<=bytes; i+=16) {
+        __m128i m = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data+i)), sync);
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data+i+TS_PACKET)), sync));
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data+i+2*TS_PACKET)), sync));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return find_sync_tail(data, i, bytes);
+}
+
+__attribute__((target("avx2")))
+static int find_sync_avx2(const unsigned char *data, int bytes)
+{
+    const __m256i sync = _mm256_set1_epi8(TS_SYNC);
+    int i;
+    for (i=0; i+SYNC_LOOKAHEAD*TS_PACKET+32<=bytes; i+=32) {
+        __m256i m = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data+i)), sync);
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data+i+TS_PACKET)), sync));
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data+i+2*TS_PACKET)), sync));
+        unsigned mask = _mm256_movemask_epi8(m);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return find_sync_tail(data, i, bytes);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static int find_sync_avx512(const unsigned char *data, int bytes)
+{
+    const __m512i sync = _mm512_set1_epi8(TS_SYNC);
+    int i;
+    for (i=0; i+SYNC_LOOKAHEAD*TS_PACKET+64<=bytes; i+=64) {
+        __mmask64 m = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data+i), sync);
+        m &= _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data+i+TS_PACKET), sync);
+        m &= _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data+i+2*TS_PACKET), sync);
+        if (m)
+            return i + __builtin_ctzll(m);
+    }
+    return find_sync_tail(data, i, bytes);
+}
+#endif
+
+/* dispatch table in order of preference */
+static const struct {
+    const char *feature;
+    kernels_t kernels;
+} table[] = {
+#ifdef HAVE_X86
+#define KERNELS(isa, row_444_uyvy, row_422_uyvy, row_v210, row_p210_v210, xor_block, find_sync) \
+    { isa, row_444_uyvy<false>, row_422_uyvy<false>, row_v210<false>, row_p210_v210<false>, \
+           row_444_uyvy<true>,  row_422_uyvy<true>,  row_v210<true>,  row_p210_v210<true>, xor_block, find_sync }
+    { "avx512bw", KERNELS("avx512", row_444_uyvy_avx512, row_422_uyvy_avx2, row_v210_avx512, row_p210_v210_avx512, xor_block_avx512, find_sync_avx512) },
+    { "avx2",     KERNELS("avx2",   row_444_uyvy_avx2,   row_422_uyvy_avx2, row_v210_avx2,   row_p210_v210_avx2,   xor_block_avx2,   find_sync_avx2)   },
+    { "ssse3",    KERNELS("ssse3",  row_444_uyvy_sse2,   row_422_uyvy_sse2, row_v210_ssse3,  row_p210_v210_ssse3,  xor_block_sse2,   find_sync_sse2)   },
+    { "sse2",     { "sse2", row_444_uyvy_sse2<false>, row_422_uyvy_sse2<false>, row_v210_c, row_p210_v210_c,
+                            row_444_uyvy_sse2<true>,  row_422_uyvy_sse2<true>,  row_v210_c, row_p210_v210_c, xor_block_sse2, find_sync_sse2 } },
+#undef KERNELS
+#endif
+    { NULL,       { "c", row_444_uyvy_c, row_422_uyvy_c, row_v210_c, row_p210_v210_c,
+                         row_444_uyvy_c, row_422_uyvy_c, row_v210_c, row_p210_v210_c, xor_block_c, find_sync_c } },
+};
+
+/* check the cpu supports an instruction set feature */
+static bool cpu_supports(const char *feature)
+{
+    if (feature==NULL)
+        return 1;
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if (strcmp(feature, "avx512bw")==0)
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    if (strcmp(feature, "avx2")==0)
+        return __builtin_cpu_supports("avx2");
+    if (strcmp(feature, "ssse3")==0)
+        return __builtin_cpu_supports("ssse3");
+    if (strcmp(feature, "sse2")==0)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return 0;
+}
+
+const kernels_t *get_kernels()
+{
+    /* select once, at first use */
+    static const kernels_t *selected = NULL;
+    if (selected==NULL) {
+        unsigned i;
+        for (i=0; !cpu_supports(table[i].feature); i++);
+        selected = &table[i].kernels;
+    }
+    return selected;
+}
+
+const kernels_t *get_kernels(const char *isa)
+{
+    for (unsigned i=0; i<sizeof(table)/sizeof(table[0]); i++)
+        if (strcmp(isa, table[i].kernels.isa)==0)
+            return cpu_supports(table[i].feature)? &table[i].kernels : NULL;
+    return NULL;
+}
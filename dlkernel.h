@@ -0,0 +1,50 @@
+#ifndef DLKERNEL_H
+#define DLKERNEL_H
+
+#include <stdint.h>
+
+/* row kernel: 4:4:4 planar to uyvy with 4:2:2 chroma decimation */
+typedef void (*row_444_uyvy_t)(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int width);
+
+/* row kernel: 4:2:2 planar to uyvy, also used for each row of 4:2:0 */
+typedef void (*row_422_uyvy_t)(const unsigned char *y, const unsigned char *u, const unsigned char *v, unsigned char *uyvy, int width);
+
+/* row kernel: 10-bit 4:2:2 planar to v210, y1 and v210_1 are an optional
+ * second row sharing the same chroma, as in 4:2:0 input, otherwise null */
+typedef void (*row_v210_t)(const uint16_t *y0, const uint16_t *y1, const uint16_t *u, const uint16_t *v, unsigned char *v210_0, unsigned char *v210_1, int width);
+
+/* row kernel: 10-bit 4:2:2 semi-planar to v210, as p010 and p210 with msb aligned
+ * samples and interleaved chroma, y1 and v210_1 as above */
+typedef void (*row_p210_v210_t)(const uint16_t *y0, const uint16_t *y1, const uint16_t *uv, unsigned char *v210_0, unsigned char *v210_1, int width);
+
+/* block kernel: xor a block of bytes into another, as in forward error correction */
+typedef void (*xor_block_t)(unsigned char *dst, const unsigned char *src, int bytes);
+
+/* block kernel: offset of the first transport stream sync byte which is repeated at the
+ * start of the next two packets, as far as the block extends, or -1 if there is none */
+typedef int (*find_sync_t)(const unsigned char *data, int bytes);
+
+/* table of row conversion kernels for one instruction set */
+typedef struct {
+    const char *isa;
+    row_444_uyvy_t row_444_uyvy;
+    row_422_uyvy_t row_422_uyvy;
+    row_v210_t row_v210;
+    row_p210_v210_t row_p210_v210;
+    /* the same with non-temporal stores, for output that is not read again by the cpu */
+    row_444_uyvy_t row_444_uyvy_nt;
+    row_422_uyvy_t row_422_uyvy_nt;
+    row_v210_t row_v210_nt;
+    row_p210_v210_t row_p210_v210_nt;
+    /* block kernels */
+    xor_block_t xor_block;
+    find_sync_t find_sync;
+} kernels_t;
+
+/* kernels for the best instruction set supported by this cpu */
+const kernels_t *get_kernels();
+
+/* kernels for a named instruction set, or null if not supported by this cpu */
+const kernels_t *get_kernels(const char *isa);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * Description: numa placement of memory and threads.
+ * Author     : Ryan Dalzell
+ * Copyright  : (c) 2026 4i2i Communications Ltd.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "dlutil.h"
+#include "dlnuma.h"
+
+/* memory policies, as numaif.h is part of libnuma */
+#define MPOL_PREFERRED 1
+#define MPOL_BIND      2
+#define MPOL_F_NODE    (1<<0)
+#define MPOL_F_ADDR    (1<<1)
+
+/* pci vendor id of blackmagic design */
+#define BLACKMAGIC_VENDOR 0xbdbd
+
+#define MAX_NODES 64
+
+static int read_sysfs_int(const char *path, int *value, int base)
+{
+    FILE *file = fopen(path, "r");
+    if (file==NULL)
+        return -1;
+    char line[32];
+    int ret = fgets(line, sizeof(line), file)? 0 : -1;
+    fclose(file);
+    if (ret==0)
+        *value = strtol(line, NULL, base);
+    return ret;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+int num_nodes()
+{
+    int num = 0;
+    char path[64];
+    do
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", num++);
+    while (access(path, F_OK)==0);
+    return mmax(num-1, 1);
+}
+
+/* the cards are taken in pci bus order, which is the order in which the
+ * driver usually enumerates them, cards with more than one sub-device
+ * only appear once, in that case specify the node on the command line */
+int node_of_card(int index)
+{
+    DIR *dir = opendir("/sys/bus/pci/devices");
+    if (dir==NULL)
+        return -1;
+
+    /* list the blackmagic devices */
+    char *names[64];
+    int num = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))!=NULL && num<64) {
+        char path[512];
+        int vendor;
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/vendor", entry->d_name);
+        if (read_sysfs_int(path, &vendor, 16)==0 && vendor==BLACKMAGIC_VENDOR)
+            names[num++] = strdup(entry->d_name);
+    }
+    closedir(dir);
+    qsort(names, num, sizeof(char *), compare_names);
+
+    int node = -1;
+    if (index<num) {
+        char path[512];
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/numa_node", names[index]);
+        if (read_sysfs_int(path, &node, 10)<0)
+            node = -1;
+    }
+
+    for (int i=0; i<num; i++)
+        free(names[i]);
+    return node;
+}
+
+int node_of_address(void *addr)
+{
+    int node;
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0, addr, MPOL_F_NODE|MPOL_F_ADDR)<0)
+        return -1;
+    return node;
+}
+
+int bind_memory_to_node(void *addr, size_t length, int node)
+{
+    if (node<0 || node>=MAX_NODES)
+        return -1;
+    unsigned long mask = 1ul << node;
+    return syscall(SYS_mbind, addr, length, MPOL_BIND, &mask, MAX_NODES, 0);
+}
+
+/* parse a sysfs cpu list, e.g. "0-7,16-23" */
+static int node_cpus(int node, cpu_set_t *cpus)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *file = fopen(path, "r");
+    if (file==NULL)
+        return -1;
+    char line[1024];
+    if (!fgets(line, sizeof(line), file)) {
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    CPU_ZERO(cpus);
+    char *p = line;
+    while (*p>='0' && *p<='9') {
+        int first = strtol(p, &p, 10);
+        int last = first;
+        if (*p=='-')
+            last = strtol(p+1, &p, 10);
+        for (int cpu=first; cpu<=last && cpu<CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, cpus);
+        if (*p==',')
+            p++;
+    }
+    return CPU_COUNT(cpus)? 0 : -1;
+}
+
+int bind_thread_to_node(int node)
+{
+    if (node<0 || node>=MAX_NODES)
+        return -1;
+
+    /* run on the cpus of the node */
+    cpu_set_t cpus;
+    if (node_cpus(node, &cpus)<0)
+        return -1;
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)!=0)
+        return -1;
+
+    /* and prefer memory local to the node */
+    unsigned long mask = 1ul << node;
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, MAX_NODES);
+}
+
+const char *describe_node_cpus(int node)
+{
+    static char string[1024];
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    string[0] = '\0';
+    FILE *file = fopen(path, "r");
+    if (file) {
+        if (fgets(string, sizeof(string), file))
+            string[strcspn(string, "\n")] = '\0';
+        fclose(file);
+    }
+    return string;
+}
@@ -0,0 +1,24 @@
+#ifndef DLNUMA_H
+#define DLNUMA_H
+
+#include <stddef.h>
+
+/* number of numa nodes in the system */
+int num_nodes();
+
+/* numa node nearest to the decklink card with the given index, or -1 if unknown */
+int node_of_card(int index);
+
+/* number of the node whose memory holds the given address, or -1 if unknown */
+int node_of_address(void *addr);
+
+/* bind a range of memory to a node, before it is faulted in */
+int bind_memory_to_node(void *addr, size_t length, int node);
+
+/* bind the calling thread, and any threads it later creates, to the cpus and memory of a node */
+int bind_thread_to_node(int node);
+
+/* describe the cpus of a node */
+const char *describe_node_cpus(int node);
+
+#endif
@@ -0,0 +1,602 @@
+/*
+ * Description: object interfaces to video and audio outputs.
+ * Author     : Ryan Dalzell
+ * Copyright  : (c) 2026 4i2i Communications Ltd.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "dlutil.h"
+#include "dloutput.h"
+
+using namespace std;
+
+/* output video frame class */
+dlframe::dlframe(IDeckLinkMutableVideoFrame *f)
+{
+    refcnt = 1;
+    frame = f;
+    buffer = NULL;
+    width = frame->GetWidth();
+    height = frame->GetHeight();
+    rowbytes = frame->GetRowBytes();
+}
+
+dlframe::dlframe(IDeckLinkVideoBuffer *b, long w, long h, long r)
+{
+    refcnt = 1;
+    frame = NULL;
+    buffer = b;
+    buffer->AddRef();
+    width = w;
+    height = h;
+    rowbytes = r;
+}
+
+dlframe::~dlframe()
+{
+    /* the frame object of the card releases its own video buffer */
+    if (frame)
+        frame->Release();
+    if (buffer)
+        buffer->Release();
+}
+
+ULONG dlframe::AddRef()
+{
+    return __atomic_add_fetch(&refcnt, 1, __ATOMIC_ACQ_REL);
+}
+
+ULONG dlframe::Release()
+{
+    ULONG ret = __atomic_sub_fetch(&refcnt, 1, __ATOMIC_ACQ_REL);
+    if (!ret)
+        delete this;
+    return ret;
+}
+
+HRESULT dlframe::SetTimecodeFromComponents(BMDTimecodeFormat format, uint8_t hours, uint8_t minutes, uint8_t seconds, uint8_t frames, BMDTimecodeFlags flags)
+{
+    if (frame)
+        return frame->SetTimecodeFromComponents(format, hours, minutes, seconds, frames, flags);
+    return S_OK;
+}
+
+/* virtual base class for outputs */
+dloutput::dloutput()
+{
+}
+
+dloutput::~dloutput()
+{
+}
+
+/* decklink card output class */
+dldecklink::dldecklink()
+{
+    iterator = NULL;
+    card = NULL;
+    output = NULL;
+    config = NULL;
+}
+
+dldecklink::~dldecklink()
+{
+    if (config)
+        config->Release();
+    if (output)
+        output->Release();
+    if (card)
+        card->Release();
+    if (iterator)
+        iterator->Release();
+}
+
+int dldecklink::open(int index)
+{
+    /* initialise the DeckLink API */
+    iterator = CreateDeckLinkIteratorInstance();
+    if (iterator==NULL)
+        dlexit("error: could not initialise, the DeckLink driver may not be installed");
+
+    /* connect to the card with the given index */
+    for (int i=0; i<=index; i++)
+        if (iterator->Next(&card)!=S_OK)
+            dlexit("error: failed to find DeckLink card with index %d", i);
+
+    /* obtain the audio/video output interface */
+    void *voidptr;
+    if (card->QueryInterface(IID_IDeckLinkOutput, &voidptr)!=S_OK)
+        dlexit("error: could not obtain the video output interface");
+    output = (IDeckLinkOutput *)voidptr;
+
+    /* configure the decklink card to output on SDI single-link only
+     * and smpte level A for 3G, and PsF set to off,
+     * this is a necessary precaution as it appears that these configurations
+     * essentially have random default values on 4K Extreme 12G cards */
+    if (card->QueryInterface(IID_IDeckLinkConfiguration, &voidptr)!=S_OK)
+        dlexit("error: could not obtain the configuration interface");
+    config = (IDeckLinkConfiguration *)voidptr;
+    if (config->SetInt(bmdDeckLinkConfigVideoOutputConnection, bmdVideoConnectionSDI)!=S_OK)
+        dlmessage("warning: failed to set card configuration to output SDI");
+    if (config->SetInt(bmdDeckLinkConfigSDIOutputLinkConfiguration, bmdLinkConfigurationSingleLink)!=S_OK)
+        dlmessage("warning: failed to set card configuration to single link SDI");
+    if (config->SetFlag(bmdDeckLinkConfigSMPTELevelAOutput, true)!=S_OK)
+        dlmessage("warning: failed to set card configuration to SMPTE A");
+    if (config->SetFlag(bmdDeckLinkConfigOutput1080pAsPsF, false))
+        dlmessage("warning: failed to set card configuration to not use PsF");
+
+    return 0;
+}
+
+int dldecklink::find_mode(int width, int height, bool interlaced, float framerate, bool allowhalfrate, displaymode_t *m)
+{
+    IDeckLinkDisplayModeIterator *modes;
+    if (output->GetDisplayModeIterator(&modes) != S_OK)
+        dlerror("failed to get display mode iterator");
+
+    /* find mode for given width and height */
+    int ret = -1;
+    IDeckLinkDisplayMode *mode;
+    BMDTimeValue framerate_duration;
+    BMDTimeScale framerate_scale;
+    while (ret<0 && modes->Next(&mode) == S_OK) {
+        mode->GetFrameRate(&framerate_duration, &framerate_scale);
+        if (mode->GetWidth()==width && mode->GetHeight()==height) {
+            if ((mode->GetFieldDominance()==bmdProgressiveFrame) ^ interlaced) {
+                /* look for an integer frame rate match */
+                if ((framerate_scale / framerate_duration)==(int)floor(framerate))
+                    ret = 0;
+                /* also look for a half-rate match, to support 1080p60 in a hacky way */
+                else if (allowhalfrate && (framerate_scale / framerate_duration)==(int)floor(framerate/2))
+                    ret = 1;
+            }
+        }
+        if (ret>=0) {
+            const char *name = NULL;
+            m->id = mode->GetDisplayMode();
+            m->width = mode->GetWidth();
+            m->height = mode->GetHeight();
+            m->progressive = mode->GetFieldDominance()==bmdProgressiveFrame;
+            m->duration = framerate_duration;
+            m->scale = framerate_scale;
+            m->name[0] = '\0';
+            if (mode->GetName(&name)==S_OK)
+                snprintf(m->name, sizeof(m->name), "%s", name);
+            free((char *)name);
+        }
+        mode->Release();
+    }
+    modes->Release();
+
+    return ret;
+}
+
+HRESULT dldecklink::SetScheduledFrameCompletionCallback(IDeckLinkVideoOutputCallback *callback)
+{
+    return output->SetScheduledFrameCompletionCallback(callback);
+}
+
+HRESULT dldecklink::RowBytesForPixelFormat(BMDPixelFormat pixelFormat, int32_t width, int32_t *rowBytes)
+{
+    return output->RowBytesForPixelFormat(pixelFormat, width, rowBytes);
+}
+
+HRESULT dldecklink::EnableVideoOutput(const displaymode_t *mode, BMDVideoOutputFlags flags)
+{
+    return output->EnableVideoOutput(mode->id, flags);
+}
+
+HRESULT dldecklink::DisableVideoOutput()
+{
+    return output->DisableVideoOutput();
+}
+
+HRESULT dldecklink::CreateVideoFrameWithBuffer(int32_t width, int32_t height, int32_t rowBytes, BMDPixelFormat pixelFormat, BMDFrameFlags flags, IDeckLinkVideoBuffer *buffer, dlframe **frame)
+{
+    IDeckLinkMutableVideoFrame *f;
+    HRESULT result = output->CreateVideoFrameWithBuffer(width, height, rowBytes, pixelFormat, flags, buffer, &f);
+    if (result==S_OK)
+        *frame = new dlframe(f);
+    return result;
+}
+
+HRESULT dldecklink::ScheduleVideoFrame(dlframe *frame, BMDTimeValue displayTime, BMDTimeValue displayDuration, BMDTimeScale timeScale)
+{
+    return output->ScheduleVideoFrame(frame->frame, displayTime, displayDuration, timeScale);
+}
+
+HRESULT dldecklink::DisplayVideoFrameSync(dlframe *frame)
+{
+    return output->DisplayVideoFrameSync(frame->frame);
+}
+
+HRESULT dldecklink::GetBufferedVideoFrameCount(uint32_t *bufferedFrameCount)
+{
+    return output->GetBufferedVideoFrameCount(bufferedFrameCount);
+}
+
+HRESULT dldecklink::EnableAudioOutput(BMDAudioSampleRate sampleRate, BMDAudioSampleType sampleType, uint32_t channelCount, BMDAudioOutputStreamType streamType)
+{
+    return output->EnableAudioOutput(sampleRate, sampleType, channelCount, streamType);
+}
+
+HRESULT dldecklink::DisableAudioOutput()
+{
+    return output->DisableAudioOutput();
+}
+
+HRESULT dldecklink::BeginAudioPreroll()
+{
+    return output->BeginAudioPreroll();
+}
+
+HRESULT dldecklink::EndAudioPreroll()
+{
+    return output->EndAudioPreroll();
+}
+
+HRESULT dldecklink::ScheduleAudioSamples(void *buffer, uint32_t sampleFrameCount, BMDTimeValue streamTime, BMDTimeScale timeScale, uint32_t *sampleFramesWritten)
+{
+    return output->ScheduleAudioSamples(buffer, sampleFrameCount, streamTime, timeScale, sampleFramesWritten);
+}
+
+HRESULT dldecklink::GetBufferedAudioSampleFrameCount(uint32_t *bufferedSampleFrameCount)
+{
+    return output->GetBufferedAudioSampleFrameCount(bufferedSampleFrameCount);
+}
+
+HRESULT dldecklink::StartScheduledPlayback(BMDTimeValue playbackStartTime, BMDTimeScale timeScale, double playbackSpeed)
+{
+    return output->StartScheduledPlayback(playbackStartTime, timeScale, playbackSpeed);
+}
+
+HRESULT dldecklink::StopScheduledPlayback(BMDTimeValue stopPlaybackAtTime, BMDTimeValue *actualStopTime, BMDTimeScale timeScale)
+{
+    return output->StopScheduledPlayback(stopPlaybackAtTime, actualStopTime, timeScale);
+}
+
+HRESULT dldecklink::GetScheduledStreamTime(BMDTimeScale desiredTimeScale, BMDTimeValue *streamTime, double *playbackSpeed)
+{
+    return output->GetScheduledStreamTime(desiredTimeScale, streamTime, playbackSpeed);
+}
+
+/* simulated output class */
+dlnulloutput::dlnulloutput(bool r)
+{
+    realtime = r;
+    callback = NULL;
+    running = false;
+    video_enabled = false;
+    frame_duration = 180000/25;
+    start_time = 0;
+    start_utime = 0;
+    virtual_time = 0;
+    audio_enabled = false;
+    audio_samples = 0;
+    audio_end = 0;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+}
+
+dlnulloutput::~dlnulloutput()
+{
+    if (running)
+        StopScheduledPlayback(0, NULL, 0);
+    flush();
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+int dlnulloutput::open(int index)
+{
+    return 0;
+}
+
+/* any raster and frame rate can be simulated */
+int dlnulloutput::find_mode(int width, int height, bool interlaced, float framerate, bool allowhalfrate, displaymode_t *mode)
+{
+    mode->id = 0;
+    mode->width = width;
+    mode->height = height;
+    mode->progressive = !interlaced;
+
+    /* recognise the fractional frame rates */
+    double r = framerate*1.001;
+    if (fabs(r-lround(r))<0.01 && fabs(framerate-lround(framerate))>0.01) {
+        mode->duration = 1001;
+        mode->scale = lround(r)*1000;
+    } else {
+        mode->duration = 1000;
+        mode->scale = lround(framerate)*1000;
+    }
+    if (mode->scale<=0)
+        return -1;
+
+    snprintf(mode->name, sizeof(mode->name), "%dx%d%c%.2f (simulated)", width, height, interlaced? 'i' : 'p', (double)mode->scale/mode->duration);
+    return 0;
+}
+
+HRESULT dlnulloutput::SetScheduledFrameCompletionCallback(IDeckLinkVideoOutputCallback *c)
+{
+    callback = c;
+    return S_OK;
+}
+
+HRESULT dlnulloutput::RowBytesForPixelFormat(BMDPixelFormat pixelFormat, int32_t width, int32_t *rowBytes)
+{
+    switch (pixelFormat) {
+        case bmdFormat8BitYUV : *rowBytes = width*2; return S_OK;
+        case bmdFormat10BitYUV: *rowBytes = ((width+47)/48)*128; return S_OK;
+    }
+    return E_INVALIDARG;
+}
+
+HRESULT dlnulloutput::EnableVideoOutput(const displaymode_t *mode, BMDVideoOutputFlags flags)
+{
+    pthread_mutex_lock(&mutex);
+    video_enabled = true;
+    frame_duration = mode->duration*180000/mode->scale;
+    pthread_mutex_unlock(&mutex);
+    return S_OK;
+}
+
+HRESULT dlnulloutput::DisableVideoOutput()
+{
+    flush();
+    pthread_mutex_lock(&mutex);
+    video_enabled = false;
+    pthread_mutex_unlock(&mutex);
+    return S_OK;
+}
+
+HRESULT dlnulloutput::CreateVideoFrameWithBuffer(int32_t width, int32_t height, int32_t rowBytes, BMDPixelFormat pixelFormat, BMDFrameFlags flags, IDeckLinkVideoBuffer *buffer, dlframe **frame)
+{
+    if (buffer==NULL || frame==NULL)
+        return E_POINTER;
+    *frame = new dlframe(buffer, width, height, rowBytes);
+    return S_OK;
+}
+
+HRESULT dlnulloutput::ScheduleVideoFrame(dlframe *frame, BMDTimeValue displayTime, BMDTimeValue displayDuration, BMDTimeScale timeScale)
+{
+    pthread_mutex_lock(&mutex);
+    if (!video_enabled) {
+        pthread_mutex_unlock(&mutex);
+        return E_ACCESSDENIED;
+    }
+
+    /* keep the queue in display order */
+    scheduled_t s = { frame, displayTime*180000/timeScale, displayDuration*180000/timeScale };
+    deque<scheduled_t>::iterator i = queue.end();
+    while (i!=queue.begin() && (i-1)->time>s.time)
+        i--;
+    queue.insert(i, s);
+    frame->AddRef();
+
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+    return S_OK;
+}
+
+HRESULT dlnulloutput::DisplayVideoFrameSync(dlframe *frame)
+{
+    return S_OK;
+}
+
+HRESULT dlnulloutput::GetBufferedVideoFrameCount(uint32_t *bufferedFrameCount)
+{
+    pthread_mutex_lock(&mutex);
+    *bufferedFrameCount = queue.size();
+    pthread_mutex_unlock(&mutex);
+    return S_OK;
+}
+
+HRESULT dlnulloutput::EnableAudioOutput(BMDAudioSampleRate sampleRate, BMDAudioSampleType sampleType, uint32_t channelCount, BMDAudioOutputStreamType streamType)
+{
+    if (sampleRate!=bmdAudioSampleRate48kHz)
+        return E_INVALIDARG;
+    pthread_mutex_lock(&mutex);
+    audio_enabled = true;
+    audio_samples = 0;
+    audio_end = 0;
+    pthread_mutex_unlock(&mutex);
+    return S_OK;
+}
+
+HRESULT dlnulloutput::DisableAudioOutput()
+{
+    pthread_mutex_lock(&mutex);
+    audio_enabled = false;
+    pthread_mutex_unlock(&mutex);
+    return S_OK;
+}
+
+HRESULT dlnulloutput::BeginAudioPreroll()
+{
+    return S_OK;
+}
+
+HRESULT dlnulloutput::EndAudioPreroll()
+{
+    return S_OK;
+}
+
+HRESULT dlnulloutput::ScheduleAudioSamples(void *buffer, uint32_t sampleFrameCount, BMDTimeValue streamTime, BMDTimeScale timeScale, uint32_t *sampleFramesWritten)
+{
+    pthread_mutex_lock(&mutex);
+    if (!audio_enabled) {
+        pthread_mutex_unlock(&mutex);
+        return E_ACCESSDENIED;
+    }
+
+    /* samples are discarded, only the extent of the buffered audio is kept */
+    audio_samples += sampleFrameCount;
+    audio_end = streamTime*180000/timeScale + sampleFrameCount*180000ll/48000;
+    if (sampleFramesWritten)
+        *sampleFramesWritten = sampleFrameCount;
+
+    pthread_mutex_unlock(&mutex);
+    return S_OK;
+}
+
+HRESULT dlnulloutput::GetBufferedAudioSampleFrameCount(uint32_t *bufferedSampleFrameCount)
+{
+    pthread_mutex_lock(&mutex);
+    if (!running)
+        *bufferedSampleFrameCount = audio_samples;
+    else
+        *bufferedSampleFrameCount = mmax(audio_end - stream_time(), 0ll)*48000/180000;
+    pthread_mutex_unlock(&mutex);
+    return S_OK;
+}
+
+HRESULT dlnulloutput::StartScheduledPlayback(BMDTimeValue playbackStartTime, BMDTimeScale timeScale, double playbackSpeed)
+{
+    pthread_mutex_lock(&mutex);
+    if (running) {
+        pthread_mutex_unlock(&mutex);
+        return E_ACCESSDENIED;
+    }
+    start_time = virtual_time = playbackStartTime*180000/timeScale;
+    start_utime = get_utime();
+    running = true;
+    pthread_mutex_unlock(&mutex);
+
+    if (pthread_create(&thread, NULL, clock_thread, this)!=0) {
+        running = false;
+        return E_FAIL;
+    }
+    return S_OK;
+}
+
+HRESULT dlnulloutput::StopScheduledPlayback(BMDTimeValue stopPlaybackAtTime, BMDTimeValue *actualStopTime, BMDTimeScale timeScale)
+{
+    pthread_mutex_lock(&mutex);
+    if (!running) {
+        pthread_mutex_unlock(&mutex);
+        return S_OK;
+    }
+    sts_t stop_time = stream_time();
+    running = false;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+
+    /* the clock stops where it was */
+    start_time = virtual_time = stop_time;
+    if (actualStopTime && timeScale)
+        *actualStopTime = stop_time*timeScale/180000;
+
+    /* frames that were not displayed are flushed */
+    flush();
+    if (callback)
+        callback->ScheduledPlaybackHasStopped();
+    return S_OK;
+}
+
+HRESULT dlnulloutput::GetScheduledStreamTime(BMDTimeScale desiredTimeScale, BMDTimeValue *streamTime, double *playbackSpeed)
+{
+    pthread_mutex_lock(&mutex);
+    *streamTime = stream_time()*desiredTimeScale/180000;
+    *playbackSpeed = running? 1.0 : 0.0;
+    pthread_mutex_unlock(&mutex);
+    return S_OK;
+}
+
+/* current stream time in 180kHz, called with the mutex held */
+sts_t dlnulloutput::stream_time()
+{
+    if (!running)
+        return start_time;
+    /* audio only playback always follows the wall clock */
+    if (realtime || !video_enabled)
+        return start_time + (sts_t)(get_utime()-start_utime)*180000/1000000;
+    return virtual_time;
+}
+
+/* report completed frames to the callback and release them */
+void dlnulloutput::complete(deque<completion_t> &completions)
+{
+    for (unsigned i=0; i<completions.size(); i++) {
+        /* there is no frame object of a card to report */
+        if (callback)
+            callback->ScheduledFrameCompleted(NULL, completions[i].result);
+        completions[i].frame->Release();
+    }
+    completions.clear();
+}
+
+/* flush all scheduled frames */
+void dlnulloutput::flush()
+{
+    deque<completion_t> completions;
+
+    pthread_mutex_lock(&mutex);
+    for (unsigned i=0; i<queue.size(); i++) {
+        completion_t c = { queue[i].frame, bmdOutputFrameFlushed };
+        completions.push_back(c);
+    }
+    queue.clear();
+    pthread_mutex_unlock(&mutex);
+
+    complete(completions);
+}
+
+void *dlnulloutput::clock_thread(void *arg)
+{
+    ((dlnulloutput *)arg)->run_clock();
+    return NULL;
+}
+
+void dlnulloutput::run_clock()
+{
+    deque<completion_t> completions;
+
+    pthread_mutex_lock(&mutex);
+    for (unsigned long long tick=0; running; tick++) {
+        if (realtime || !video_enabled) {
+            /* wait for the next frame period of the wall clock */
+            unsigned long long wake = start_utime + tick*frame_duration*1000000/180000;
+            struct timespec ts = { (time_t)(wake/1000000), (long)(wake%1000000)*1000 };
+            while (running && get_utime()<wake)
+                pthread_cond_timedwait(&cond, &mutex, &ts);
+            if (!running)
+                break;
+
+            /* of the frames due at this tick, the last is displayed, late if
+             * its display period has already passed, the rest are dropped */
+            sts_t now = start_time + tick*frame_duration;
+            unsigned due = 0;
+            while (due<queue.size() && queue[due].time<=now)
+                due++;
+            for (unsigned i=0; i<due; i++) {
+                completion_t c = { queue[i].frame, bmdOutputFrameDropped };
+                if (i==due-1)
+                    c.result = queue[i].time+queue[i].duration<=now? bmdOutputFrameDisplayedLate : bmdOutputFrameCompleted;
+                completions.push_back(c);
+            }
+            queue.erase(queue.begin(), queue.begin()+due);
+        } else {
+            /* the virtual clock displays each frame as soon as it is scheduled */
+            while (running && queue.empty())
+                pthread_cond_wait(&cond, &mutex);
+            if (!running)
+                break;
+
+            virtual_time = queue.front().time;
+            completion_t c = { queue.front().frame, bmdOutputFrameCompleted };
+            completions.push_back(c);
+            queue.pop_front();
+        }
+
+        /* report without the lock, as the callback may call back into the output */
+        pthread_mutex_unlock(&mutex);
+        complete(completions);
+        pthread_mutex_lock(&mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,210 @@
+#ifndef DLOUTPUT_H
+#define DLOUTPUT_H
+
+#include <pthread.h>
+
+#include <deque>
+
+#include "DeckLinkAPI.h"
+
+#include "dlutil.h"
+
+/* a video frame for an output, wrapping the frame object of the card if there is one */
+class dlframe
+{
+public:
+    dlframe(IDeckLinkMutableVideoFrame *frame);
+    dlframe(IDeckLinkVideoBuffer *buffer, long width, long height, long rowbytes);
+
+    /* reference counting, the last release also releases the video buffer */
+    ULONG AddRef();
+    ULONG Release();
+
+    /* frame metadata */
+    long GetWidth() { return width; }
+    long GetHeight() { return height; }
+    long GetRowBytes() { return rowbytes; }
+    HRESULT SetTimecodeFromComponents(BMDTimecodeFormat format, uint8_t hours, uint8_t minutes, uint8_t seconds, uint8_t frames, BMDTimecodeFlags flags);
+
+    /* frame object of the card, null for a simulated output */
+    IDeckLinkMutableVideoFrame *frame;
+
+private:
+    ~dlframe();
+
+    unsigned refcnt;
+    IDeckLinkVideoBuffer *buffer;
+    long width;
+    long height;
+    long rowbytes;
+};
+
+/* video mode of an output */
+typedef struct {
+    BMDDisplayMode id;
+    int width;
+    int height;
+    bool progressive;
+    BMDTimeValue duration;
+    BMDTimeScale scale;
+    char name[64];
+} displaymode_t;
+
+/* virtual base class for outputs, the subset of IDeckLinkOutput used by dlplay */
+class dloutput
+{
+public:
+    dloutput();
+    virtual ~dloutput();
+
+    /* output operators */
+    virtual int open(int index) = 0;
+    /* returns 0 for a matching mode, 1 for a half frame rate match and -1 if none */
+    virtual int find_mode(int width, int height, bool interlaced, float framerate, bool allowhalfrate, displaymode_t *mode) = 0;
+
+    virtual HRESULT SetScheduledFrameCompletionCallback(IDeckLinkVideoOutputCallback *callback) = 0;
+    virtual HRESULT RowBytesForPixelFormat(BMDPixelFormat pixelFormat, int32_t width, int32_t *rowBytes) = 0;
+
+    virtual HRESULT EnableVideoOutput(const displaymode_t *mode, BMDVideoOutputFlags flags) = 0;
+    virtual HRESULT DisableVideoOutput() = 0;
+    virtual HRESULT CreateVideoFrameWithBuffer(int32_t width, int32_t height, int32_t rowBytes, BMDPixelFormat pixelFormat, BMDFrameFlags flags, IDeckLinkVideoBuffer *buffer, dlframe **frame) = 0;
+    virtual HRESULT ScheduleVideoFrame(dlframe *frame, BMDTimeValue displayTime, BMDTimeValue displayDuration, BMDTimeScale timeScale) = 0;
+    virtual HRESULT DisplayVideoFrameSync(dlframe *frame) = 0;
+    virtual HRESULT GetBufferedVideoFrameCount(uint32_t *bufferedFrameCount) = 0;
+
+    virtual HRESULT EnableAudioOutput(BMDAudioSampleRate sampleRate, BMDAudioSampleType sampleType, uint32_t channelCount, BMDAudioOutputStreamType streamType) = 0;
+    virtual HRESULT DisableAudioOutput() = 0;
+    virtual HRESULT BeginAudioPreroll() = 0;
+    virtual HRESULT EndAudioPreroll() = 0;
+    virtual HRESULT ScheduleAudioSamples(void *buffer, uint32_t sampleFrameCount, BMDTimeValue streamTime, BMDTimeScale timeScale, uint32_t *sampleFramesWritten) = 0;
+    virtual HRESULT GetBufferedAudioSampleFrameCount(uint32_t *bufferedSampleFrameCount) = 0;
+
+    virtual HRESULT StartScheduledPlayback(BMDTimeValue playbackStartTime, BMDTimeScale timeScale, double playbackSpeed) = 0;
+    virtual HRESULT StopScheduledPlayback(BMDTimeValue stopPlaybackAtTime, BMDTimeValue *actualStopTime, BMDTimeScale timeScale) = 0;
+    virtual HRESULT GetScheduledStreamTime(BMDTimeScale desiredTimeScale, BMDTimeValue *streamTime, double *playbackSpeed) = 0;
+
+    /* output metadata */
+    virtual const char *description() { return "unknown"; }
+};
+
+/* decklink card output class */
+class dldecklink : public dloutput
+{
+public:
+    dldecklink();
+    ~dldecklink();
+
+    virtual int open(int index);
+    virtual int find_mode(int width, int height, bool interlaced, float framerate, bool allowhalfrate, displaymode_t *mode);
+
+    virtual HRESULT SetScheduledFrameCompletionCallback(IDeckLinkVideoOutputCallback *callback);
+    virtual HRESULT RowBytesForPixelFormat(BMDPixelFormat pixelFormat, int32_t width, int32_t *rowBytes);
+
+    virtual HRESULT EnableVideoOutput(const displaymode_t *mode, BMDVideoOutputFlags flags);
+    virtual HRESULT DisableVideoOutput();
+    virtual HRESULT CreateVideoFrameWithBuffer(int32_t width, int32_t height, int32_t rowBytes, BMDPixelFormat pixelFormat, BMDFrameFlags flags, IDeckLinkVideoBuffer *buffer, dlframe **frame);
+    virtual HRESULT ScheduleVideoFrame(dlframe *frame, BMDTimeValue displayTime, BMDTimeValue displayDuration, BMDTimeScale timeScale);
+    virtual HRESULT DisplayVideoFrameSync(dlframe *frame);
+    virtual HRESULT GetBufferedVideoFrameCount(uint32_t *bufferedFrameCount);
+
+    virtual HRESULT EnableAudioOutput(BMDAudioSampleRate sampleRate, BMDAudioSampleType sampleType, uint32_t channelCount, BMDAudioOutputStreamType streamType);
+    virtual HRESULT DisableAudioOutput();
+    virtual HRESULT BeginAudioPreroll();
+    virtual HRESULT EndAudioPreroll();
+    virtual HRESULT ScheduleAudioSamples(void *buffer, uint32_t sampleFrameCount, BMDTimeValue streamTime, BMDTimeScale timeScale, uint32_t *sampleFramesWritten);
+    virtual HRESULT GetBufferedAudioSampleFrameCount(uint32_t *bufferedSampleFrameCount);
+
+    virtual HRESULT StartScheduledPlayback(BMDTimeValue playbackStartTime, BMDTimeScale timeScale, double playbackSpeed);
+    virtual HRESULT StopScheduledPlayback(BMDTimeValue stopPlaybackAtTime, BMDTimeValue *actualStopTime, BMDTimeScale timeScale);
+    virtual HRESULT GetScheduledStreamTime(BMDTimeScale desiredTimeScale, BMDTimeValue *streamTime, double *playbackSpeed);
+
+    virtual const char *description() { return "decklink"; }
+
+private:
+    IDeckLinkIterator *iterator;
+    IDeckLink *card;
+    IDeckLinkOutput *output;
+    IDeckLinkConfiguration *config;
+};
+
+/* simulated output class, frames are completed by a clock at the frame rate of the mode,
+ * either in real time or, with a virtual clock, as soon as they are scheduled */
+class dlnulloutput : public dloutput
+{
+public:
+    dlnulloutput(bool realtime);
+    ~dlnulloutput();
+
+    virtual int open(int index);
+    virtual int find_mode(int width, int height, bool interlaced, float framerate, bool allowhalfrate, displaymode_t *mode);
+
+    virtual HRESULT SetScheduledFrameCompletionCallback(IDeckLinkVideoOutputCallback *callback);
+    virtual HRESULT RowBytesForPixelFormat(BMDPixelFormat pixelFormat, int32_t width, int32_t *rowBytes);
+
+    virtual HRESULT EnableVideoOutput(const displaymode_t *mode, BMDVideoOutputFlags flags);
+    virtual HRESULT DisableVideoOutput();
+    virtual HRESULT CreateVideoFrameWithBuffer(int32_t width, int32_t height, int32_t rowBytes, BMDPixelFormat pixelFormat, BMDFrameFlags flags, IDeckLinkVideoBuffer *buffer, dlframe **frame);
+    virtual HRESULT ScheduleVideoFrame(dlframe *frame, BMDTimeValue displayTime, BMDTimeValue displayDuration, BMDTimeScale timeScale);
+    virtual HRESULT DisplayVideoFrameSync(dlframe *frame);
+    virtual HRESULT GetBufferedVideoFrameCount(uint32_t *bufferedFrameCount);
+
+    virtual HRESULT EnableAudioOutput(BMDAudioSampleRate sampleRate, BMDAudioSampleType sampleType, uint32_t channelCount, BMDAudioOutputStreamType streamType);
+    virtual HRESULT DisableAudioOutput();
+    virtual HRESULT BeginAudioPreroll();
+    virtual HRESULT EndAudioPreroll();
+    virtual HRESULT ScheduleAudioSamples(void *buffer, uint32_t sampleFrameCount, BMDTimeValue streamTime, BMDTimeScale timeScale, uint32_t *sampleFramesWritten);
+    virtual HRESULT GetBufferedAudioSampleFrameCount(uint32_t *bufferedSampleFrameCount);
+
+    virtual HRESULT StartScheduledPlayback(BMDTimeValue playbackStartTime, BMDTimeScale timeScale, double playbackSpeed);
+    virtual HRESULT StopScheduledPlayback(BMDTimeValue stopPlaybackAtTime, BMDTimeValue *actualStopTime, BMDTimeScale timeScale);
+    virtual HRESULT GetScheduledStreamTime(BMDTimeScale desiredTimeScale, BMDTimeValue *streamTime, double *playbackSpeed);
+
+    virtual const char *description() { return realtime? "null" : "null (virtual clock)"; }
+
+private:
+    /* a scheduled frame, times in 180kHz */
+    typedef struct {
+        dlframe *frame;
+        sts_t time;
+        sts_t duration;
+    } scheduled_t;
+
+    /* a frame completion to report to the callback */
+    typedef struct {
+        dlframe *frame;
+        BMDOutputFrameCompletionResult result;
+    } completion_t;
+
+    static void *clock_thread(void *arg);
+    void run_clock();
+    void complete(std::deque<completion_t> &completions);
+    sts_t stream_time();
+    void flush();
+
+    bool realtime;
+    IDeckLinkVideoOutputCallback *callback;
+
+    /* clock thread */
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool running;
+
+    /* video state, protected by the mutex */
+    bool video_enabled;
+    sts_t frame_duration;
+    std::deque<scheduled_t> queue;
+
+    /* playback clock, the stream time at the start of playback and the
+     * wall clock time in usecs at that point, or the virtual clock */
+    sts_t start_time;
+    unsigned long long start_utime;
+    sts_t virtual_time;
+
+    /* audio state */
+    bool audio_enabled;
+    uint32_t audio_samples;
+    sts_t audio_end;
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 extern "C" {
     #include <mpeg2dec/mpeg2.h>
@@ -31,12 +32,17 @@ extern "C" {
 #include "dlutil.h"
 #include "dlterm.h"
 #include "dldecode.h"
+#include "dlconv.h"
+#include "dlkernel.h"
+#include "dlpool.h"
 #include "dlalloc.h"
 #include "dlts.h"
+#include "dlclock.h"
+#include "dloutput.h"
+#include "dlnuma.h"
 
 /* compile options */
 #define USE_TERMIOS
-//#define USE_MMAP
 
 const char *appname = "dlplay";
 
@@ -50,6 +56,12 @@ const int MAX_HISTORY_FRAMES = PREROLL_FRAMES*3/2;  /* the history buffer needs
 bool preroll;
 unsigned int completed;
 unsigned int late, dropped, flushed;
+unsigned long long network_dropped;
+unsigned long long network_lost, network_late, network_recovered;
+ringstats_t network_ring;
+bool clock_locked;
+double clock_ratio;
+unsigned long long clock_repeated, clock_dropped;
 bool pause_mode = 0;
 
 typedef struct TimeCode_ {
@@ -62,7 +74,7 @@ typedef struct TimeCode_ {
 class callback : public IDeckLinkVideoOutputCallback, public IDeckLinkAudioOutputCallback
 {
 public:
-    callback(IDeckLinkOutput *output);
+    callback(dloutput *output);
 
 protected:
 
@@ -79,7 +91,7 @@ public:
     virtual HRESULT STDMETHODCALLTYPE RenderAudioSamples(bool preroll);
 };
 
-callback::callback(IDeckLinkOutput *output)
+callback::callback(dloutput *output)
 {
     if (output->SetScheduledFrameCompletionCallback(this)!=S_OK)
         dlexit("%s: error: could not set video callback object");
@@ -144,7 +156,22 @@ HRESULT callback::RenderAudioSamples(bool preroll)
     return S_OK;
 }
 
-static void set_timecode(IDeckLinkMutableVideoFrame *frame, BMDTimeScale framerate_scale, BMDTimeValue framerate_duration, bool progressive, TimeCode *timecode, bool reset)
+/* choose the source for file input, memory mapped unless reading ahead or with direct i/o */
+static dlsource *file_source(const char *filename, bool direct, int readahead)
+{
+    if (direct)
+        return new dldirect(readahead? readahead : 4);
+    if (readahead)
+        return new dluring(readahead);
+
+    /* pipes and devices cannot be memory mapped */
+    struct stat st;
+    if (stat(filename, &st)==0 && S_ISREG(st.st_mode))
+        return new dlmmap();
+    return new dlfile();
+}
+
+static void set_timecode(dlframe *frame, BMDTimeScale framerate_scale, BMDTimeValue framerate_duration, bool progressive, TimeCode *timecode, bool reset)
 {
     const int framerate = (int)((framerate_scale + (framerate_duration - 1)) / framerate_duration);
     const bool fractional = framerate_duration % 10 ? true : false;
@@ -236,7 +263,19 @@ void usage(int exitcode)
     fprintf(stderr, "  -~, --audiooonly    : play audio only (default: video and audio if possible)\n");
     fprintf(stderr, "  -p, --video-pid     : decode specific video pid from transport stream (default: first program)\n");
     fprintf(stderr, "  -o, --audio-pid     : decode specific audio pid from transport stream (default: first program)\n");
+    fprintf(stderr, "  -Q, --ring-depth    : datagrams buffered by the network receive thread, 0 to receive when decoding (default: 4096)\n");
+    fprintf(stderr, "  -F, --fec           : recover lost rtp packets from smpte 2022-1 fec streams on the ports two and four above, waiting up to this many packets (default: off, %d if no value)\n", RTP_FEC_WINDOW);
+    fprintf(stderr, "  -K, --free-run      : play a live transport stream on the output clock, without recovering the encoder clock from the pcr (default: off)\n");
+    fprintf(stderr, "  -R, --readahead     : number of asynchronous reads in flight for file input, 2 to %d (default: synchronous reads)\n", MAX_READAHEAD);
+    fprintf(stderr, "  -D, --direct        : read file input with direct i/o, bypassing the page cache, a comma separated list of files is read as stripes of whole frames, which must be a multiple of the block size of the devices (default: off)\n");
     fprintf(stderr, "  -i, --index         : index of decklink card to use (default: 0)\n");
+    fprintf(stderr, "  -U, --numa-node     : numa node for threads and video buffers, -1 for none (default: node of card)\n");
+    fprintf(stderr, "  -j, --threads       : number of threads for pixel format conversion (default: 1)\n");
+    fprintf(stderr, "  -N, --nontemporal   : write video frames with non-temporal stores (default: off)\n");
+    fprintf(stderr, "  -P, --preallocate   : allocate all video buffers before playback, backed by huge pages (default: on demand)\n");
+    fprintf(stderr, "  -B, --memory-budget : limit in MB on memory for video buffers, allocation waits when reached (default: no limit)\n");
+    fprintf(stderr, "  -L, --mlock         : lock preallocated video buffers in memory (default: off)\n");
+    fprintf(stderr, "  -O, --null-output   : play to a simulated output without a card, =virtual to run as fast as possible (default: off)\n");
     fprintf(stderr, "  -q, --quiet         : decrease verbosity, can be used multiple times\n");
     fprintf(stderr, "  -v, --verbose       : increase verbosity, can be used multiple times\n");
     fprintf(stderr, "  --                  : disable argument processing\n");
@@ -246,7 +285,7 @@ void usage(int exitcode)
 
 void *display_status(void *arg)
 {
-    IDeckLinkOutput *output = (IDeckLinkOutput *)arg;
+    dloutput *output = (dloutput *)arg;
 
     sleep(1);
 
@@ -273,6 +312,20 @@ void *display_status(void *arg)
                 len += snprintf(string+len, sizeof(string)-len, " late %d frame%s", late, late>1? "s" : "");
             if (dropped)
                 len += snprintf(string+len, sizeof(string)-len, " dropped %d frame%s", dropped, dropped>1? "s" : "");
+            if (network_ring.depth)
+                len += snprintf(string+len, sizeof(string)-len, " ring %u%% high %u%%", network_ring.fill*100/network_ring.depth, network_ring.watermark*100/network_ring.depth);
+            if (network_ring.overflows)
+                len += snprintf(string+len, sizeof(string)-len, " ring overflow %llu datagram%s", network_ring.overflows, network_ring.overflows>1? "s" : "");
+            if (network_dropped)
+                len += snprintf(string+len, sizeof(string)-len, " network dropped %llu datagram%s", network_dropped, network_dropped>1? "s" : "");
+            if (network_ring.truncated)
+                len += snprintf(string+len, sizeof(string)-len, " truncated %llu datagram%s", network_ring.truncated, network_ring.truncated>1? "s" : "");
+            if (network_lost || network_late)
+                len += snprintf(string+len, sizeof(string)-len, " rtp lost %llu late %llu", network_lost, network_late);
+            if (network_recovered)
+                len += snprintf(string+len, sizeof(string)-len, " fec recovered %llu", network_recovered);
+            if (clock_locked)
+                len += snprintf(string+len, sizeof(string)-len, " clock %+.1fppm repeated %llu dropped %llu", (clock_ratio-1.0)*1e6, clock_repeated, clock_dropped);
             dlstatus("performance: %s", string);
         }
 
@@ -293,6 +346,7 @@ int main(int argc, char *argv[])
     int pic_height = 0;
     int dis_width = 0;
     int dis_height = 0;
+    int32_t rowbytes = 0;
     bool interlaced = 0;
     float framerate = 0.0;
     bool halfframerate = false;
@@ -310,6 +364,19 @@ int main(int argc, char *argv[])
     int videoonly = 0;
     int audioonly = 0;
     int index = 0;
+    int threads = 1;
+    int numanode = -2;  /* automatic */
+    bool nontemporal = false;
+    bool preallocate = false;
+    bool lockmemory = false;
+    size_t budget = 0;
+    bool nulloutput = false;
+    int readahead = 0;
+    bool direct = false;
+    unsigned ringdepth = 4096;
+    unsigned fec = 0;
+    bool freerun = false;
+    bool realtime = true;
     int verbose = 0;
     bool resettime = false;
 
@@ -320,7 +387,11 @@ int main(int argc, char *argv[])
     /* decoded audio buffer */
     size_t aud_size = 0;
     unsigned char *aud_data = NULL;
+    unsigned char *aud_resampled = NULL;
+    unsigned char *aud_sched = NULL;    /* audio samples being enqueued */
+    uint32_t aud_frames = 0;
     uint32_t aud_rem = 0;              /* audio samples remaining to enqueue */
+    sts_t aud_time = 0;
 
     /* transport stream variables */
     int vid_pid = 0;
@@ -352,14 +423,26 @@ int main(int argc, char *argv[])
             {"novideo",   0, NULL, '~'},
             {"video-pid", 1, NULL, 'p'},
             {"audio-pid", 1, NULL, 'o'},
+            {"ring-depth", 1, NULL, 'Q'},
+            {"fec",       2, NULL, 'F'},
+            {"free-run",  0, NULL, 'K'},
+            {"readahead", 1, NULL, 'R'},
+            {"direct",    0, NULL, 'D'},
             {"index",     1, NULL, 'i'},
+            {"threads",   1, NULL, 'j'},
+            {"numa-node", 1, NULL, 'U'},
+            {"nontemporal", 0, NULL, 'N'},
+            {"preallocate", 0, NULL, 'P'},
+            {"mlock",     0, NULL, 'L'},
+            {"memory-budget", 1, NULL, 'B'},
+            {"null-output", 2, NULL, 'O'},
             {"quiet",     0, NULL, 'q'},
             {"verbose",   0, NULL, 'v'},
             {"help",      0, NULL, 'h'},
             {NULL,        0, NULL,  0 }
         };
 
-        int optchar = getopt_long(argc, argv, "s:f:tI:ra:n:2l=~p:o:i:qvh", long_options, NULL);
+        int optchar = getopt_long(argc, argv, "s:f:tI:ra:n:2l=~p:o:Q:F::KR:Di:j:U:NPLB:O::qvh", long_options, NULL);
         if (optchar==-1)
             break;
 
@@ -431,6 +514,76 @@ int main(int argc, char *argv[])
                     dlexit("invalid value for card index: %d", index);
                 break;
 
+            case 'Q':
+                if (atoi(optarg)<0)
+                    dlexit("invalid value for ring depth: %s", optarg);
+                ringdepth = atoi(optarg);
+                break;
+
+            case 'F':
+                fec = RTP_FEC_WINDOW;
+                if (optarg) {
+                    if (atoi(optarg)<=0)
+                        dlexit("invalid value for fec latency: %s", optarg);
+                    fec = atoi(optarg);
+                }
+                break;
+
+            case 'K':
+                freerun = true;
+                break;
+
+            case 'R':
+                readahead = atoi(optarg);
+                if (readahead<2 || readahead>MAX_READAHEAD)
+                    dlexit("invalid value for read-ahead depth: %d", readahead);
+                break;
+
+            case 'D':
+                direct = true;
+                break;
+
+            case 'j':
+                threads = atoi(optarg);
+                if (threads<1 || threads>MAX_POOL_THREADS)
+                    dlexit("invalid value for number of threads: %d", threads);
+                break;
+
+            case 'U':
+                numanode = atoi(optarg);
+                if (numanode<-1 || numanode>=num_nodes())
+                    dlexit("invalid value for numa node: %d", numanode);
+                break;
+
+            case 'N':
+                nontemporal = true;
+                break;
+
+            case 'P':
+                preallocate = true;
+                break;
+
+            case 'L':
+                preallocate = true;
+                lockmemory = true;
+                break;
+
+            case 'B':
+                budget = (size_t)atoi(optarg) << 20;
+                if (atoi(optarg)<1)
+                    dlexit("invalid value for memory budget: %s", optarg);
+                break;
+
+            case 'O':
+                nulloutput = true;
+                if (optarg) {
+                    if (strcmp(optarg, "virtual")==0)
+                        realtime = false;
+                    else
+                        dlexit("invalid value for null output: %s", optarg);
+                }
+                break;
+
             case 'q':
                 verbose--;
                 break;
@@ -462,45 +615,34 @@ int main(int argc, char *argv[])
     if (!filename)
         usage(1);
 
-    /* initialise the DeckLink API */
-    IDeckLinkIterator *iterator = CreateDeckLinkIteratorInstance();
-    if (iterator==NULL)
-        dlexit("error: could not initialise, the DeckLink driver may not be installed");
-
-    /* connect to the first card in the system */
-    IDeckLink *card;
-    int i;
-    for (i=0; i<=index; i++)
-        if (iterator->Next(&card)!=S_OK) {
-            dlexit("error: failed to find DeckLink card with index %d", i);
-        iterator->Release();
+    /* place threads and video buffers on the numa node of the card,
+     * the conversion and decoder threads inherit the binding */
+    if (numanode==-2)
+        numanode = (!nulloutput && num_nodes()>1)? node_of_card(index) : -1;
+    if (numanode>=0) {
+        if (bind_thread_to_node(numanode)<0)
+            dlmessage("warning: failed to bind threads to numa node %d", numanode);
+        else if (verbose>=1)
+            dlmessage("info: threads bound to numa node %d, cpus %s", numanode, describe_node_cpus(numanode));
+        alloc.set_node(numanode);
     }
 
-    /* obtain the audio/video output interface */
-    void *voidptr;
-    if (card->QueryInterface(IID_IDeckLinkOutput, &voidptr)!=S_OK)
-        dlexit("%s: error: could not obtain the video output interface");
-    IDeckLinkOutput *output = (IDeckLinkOutput *)voidptr;
+    /* start the conversion worker threads */
+    convert_set_threads(threads);
+
+    /* open the output, either a decklink card or a simulated output */
+    dloutput *output;
+    if (nulloutput)
+        output = new dlnulloutput(realtime);
+    else
+        output = new dldecklink;
+    output->open(index);
+    if (verbose>=1)
+        dlmessage("info: output to %s", output->description());
 
     /* create callback object */
     class callback the_callback(output);
 
-    /* configure the decklink card to output on SDI single-link only
-     * and smpte level A for 3G, and PsF set to off,
-     * this is a necessary precaution as it appears that these configurations
-     * essentially have random default values on 4K Extreme 12G cards */
-    if (card->QueryInterface(IID_IDeckLinkConfiguration, &voidptr)!=S_OK)
-        dlexit("error: could not obtain the configuration interface");
-    IDeckLinkConfiguration *config = (IDeckLinkConfiguration *)voidptr;
-    if (config->SetInt(bmdDeckLinkConfigVideoOutputConnection, bmdVideoConnectionSDI)!=S_OK)
-        dlmessage("warning: failed to set card configuration to output SDI");
-    if (config->SetInt(bmdDeckLinkConfigSDIOutputLinkConfiguration, bmdLinkConfigurationSingleLink)!=S_OK)
-        dlmessage("warning: failed to set card configuration to single link SDI");
-    if (config->SetFlag(bmdDeckLinkConfigSMPTELevelAOutput, true)!=S_OK)
-        dlmessage("warning: failed to set card configuration to SMPTE A");
-    if (config->SetFlag(bmdDeckLinkConfigOutput1080pAsPsF, false))
-        dlmessage("warning: failed to set card configuration to not use PsF");
-
     /* initialise timecode */
     TimeCode timecode = {0};
     bool reset_timecode = true;
@@ -522,7 +664,10 @@ int main(int argc, char *argv[])
 
         /* create the input data source */
         dlsource *source = NULL;
-        if (strncmp(filename, "udp://", 6)==0) {
+        bool live = false;
+        if (strncmp(filename, "udp://", 6)==0 || strncmp(filename, "rtp://", 6)==0) {
+            bool rtp = strncmp(filename, "rtp://", 6)==0;
+
             /* determine address, if given */
             char address[32] = {0};
             strncpy(address, filename + 6, sizeof(address)-1);
@@ -536,15 +681,23 @@ int main(int argc, char *argv[])
             }
 
             /* open network socket */
-            if (strtol(address, NULL, 10)>=224 && strtol(address, NULL, 10)<=239)
-                /* multicast */
-                source = new dlsock(address, interface);
-            else
-                /* unicast */
-                source = new dlsock();
+            dlsock *sock;
+            bool multicast = strtol(address, NULL, 10)>=224 && strtol(address, NULL, 10)<=239;
+            if (rtp) {
+                dlrtp *r = multicast? new dlrtp(address, interface) : new dlrtp();
+                r->set_fec(fec);
+                sock = r;
+            } else {
+                if (fec)
+                    dlmessage("warning: fec is only supported for rtp streams");
+                sock = multicast? new dlsock(address, interface) : new dlsock();
+            }
+            sock->set_ring(ringdepth);
+            source = sock;
             source->open(port);
 
             filetype = source->autodetect();
+            live = true;
         } else if (strncmp(filename, "tcp://", 6)==0) {
             source = new dltcpsock();
             const char *port = strchr(filename+6, ':');
@@ -555,19 +708,11 @@ int main(int argc, char *argv[])
 
             filetype = source->autodetect();
         } else if (strncmp(filename, "file://", 7)==0) {
-#ifdef USE_MMAP
-            source = new dlmmap();
-#else
-            source = new dlfile();
-#endif
+            source = file_source(filename+7, direct, readahead);
             source->open(filename+7);
             filetype = source->autodetect();
         } else if (strstr(filename, "://")==NULL) {
-#ifdef USE_MMAP
-            source = new dlmmap();
-#else
-            source = new dlfile();
-#endif
+            source = file_source(filename, direct, readahead);
             source->open(filename);
             filetype = source->autodetect();
         } else
@@ -575,21 +720,29 @@ int main(int argc, char *argv[])
 
         /* create the video and audio format filters and decoders */
         dlformat *vid_fmt = NULL, *aud_fmt = NULL;
+        dltsdemux *demux = NULL;
         switch (filetype) {
             case TS :
             {
+                /* read the program maps once for both the video and audio pids */
+                int program_types[TS_MAX_STREAMS], program_pids[TS_MAX_STREAMS];
+                int num_streams = find_program_streams(program_types, program_pids, TS_MAX_STREAMS, source, 0);
+                source->rewind();
+
+                /* the video and audio formats share one pass over the stream, a live stream is read a datagram at a time */
+                demux = new dltsdemux(source, live? 7*188 : TS_BLOCKSIZE);
+
                 /* look for a video pid */
                 int stream_type = 0;
                 if (!audioonly) {
                     int video_stream_types[] = { 0x02, 0x80, 0x1B, 0x24 };
-                    vid_pid = find_pid_for_stream_type(video_stream_types, sizeof(video_stream_types)/sizeof(int), &stream_type, source, 0);
-                    source->rewind();
+                    vid_pid = find_pid_in_program(video_stream_types, sizeof(video_stream_types)/sizeof(int), &stream_type, program_types, program_pids, num_streams);
                 }
 
                 if (vid_pid) {
                     /* create a format filter for transport stream */
                     dltstream *ts = new dltstream(vid_pid);
-                    ts->attach(source);
+                    ts->attach(demux);
 
                     /* create a video decoder */
                     switch (stream_type) {
@@ -630,14 +783,13 @@ int main(int argc, char *argv[])
                 if (!videoonly) {
                     int audio_stream_types[] = { 0x03, 0x04, 0x81, 0x1C, 0x06 };
                     //int audio_stream_types[] = { 0x03, 0x04 };
-                    aud_pid = find_pid_for_stream_type(audio_stream_types, sizeof(audio_stream_types)/sizeof(int), &stream_type, source, 0);
-                    source->rewind();
+                    aud_pid = find_pid_in_program(audio_stream_types, sizeof(audio_stream_types)/sizeof(int), &stream_type, program_types, program_pids, num_streams);
                 }
 
                 if (aud_pid) {
                     /* create a format filter for transport stream */
                     dltstream *ts = new dltstream(aud_pid);
-                    ts->attach(source);
+                    ts->attach(demux);
 
                     /* create an audio decoder */
                     switch (stream_type) {
@@ -796,8 +948,11 @@ int main(int argc, char *argv[])
             }
             /* note there may not be an audio stream in the file
              * in which case the audio decoder will be null */
-            if (audio)
+            if (audio) {
                 aud_data = (unsigned char *) malloc(aud_size);
+                /* room for the audio stretched by clock recovery */
+                aud_resampled = (unsigned char *) realloc(aud_resampled, aud_size + aud_size/500 + 64);
+            }
         }
 
         /* sanity check */
@@ -808,6 +963,8 @@ int main(int argc, char *argv[])
 
         if (video && verbose>=1)
             dlmessage("info: video format is %dx%d%c%.2f %s", pic_width, pic_height, interlaced? 'i' : 'p', framerate, pixelformatname[pixelformat]);
+        if (video && verbose>=1)
+            dlmessage("info: using %s conversion kernels on %d thread%s", get_kernels()->isa, threads, threads>1? "s" : "");
 
         /* determine display dimensions */
         if (sizeformat) {
@@ -841,55 +998,28 @@ int main(int argc, char *argv[])
             }
         }
 
-        /* get display mode iterator */
-        IDeckLinkDisplayMode *mode;
-        BMDTimeValue framerate_duration;
-        BMDTimeScale framerate_scale;
+        /* find the display mode */
+        displaymode_t mode;
+        BMDTimeValue framerate_duration = 1;
+        BMDTimeScale framerate_scale = 0;
         if (video) {
-            IDeckLinkDisplayModeIterator *iterator;
-            if (output->GetDisplayModeIterator(&iterator) != S_OK)
-                dlerror("failed to get display mode iterator");
-
-            /* find mode for given width and height */
-            while (iterator->Next(&mode) == S_OK) {
-                mode->GetFrameRate(&framerate_duration, &framerate_scale);
-                if (verbose>=2) {
-                    const char *name = NULL;
-                    mode->GetName(&name);
-                    //bool interlaced = mode->GetFieldDominance()!=bmdProgressiveFrame;
-                    //dlmessage("mode available: %ldx%ld%c%.2f (%s)", mode->GetWidth(), mode->GetHeight(), interlaced? 'i' : 'p', (double)framerate_scale/framerate_duration*(interlaced?2.0:1.0), name);
-                    dlmessage("mode available: %s", name);
-                    free((char *)name);
-                }
-                if (mode->GetWidth()==dis_width && mode->GetHeight()==dis_height) {
-                    if ((mode->GetFieldDominance()==bmdProgressiveFrame) ^ interlaced) {
-                        mode->GetFrameRate(&framerate_duration, &framerate_scale);
-                        /* look for an integer frame rate match */
-                        if ((framerate_scale / framerate_duration)==(int)floor(framerate))
-                            break;
-                        if (allowhalfrate) {
-                            /* also look for a half-rate match, to support 1080p60 in a hacky way */
-                            if ((framerate_scale / framerate_duration)==(int)floor(framerate/2)) {
-                                halfframerate = true;
-                                framerate /= 2;
-                                video->framerate /= 2;
-                                break;
-                            }
-                        }
-                    }
-                }
-                mode->Release();
-            }
-            iterator->Release();
+            switch (output->find_mode(dis_width, dis_height, interlaced, framerate, allowhalfrate, &mode)) {
+                case -1:
+                    dlexit("error: failed to find mode for %dx%d%c%.2f", pic_width, pic_height, interlaced? 'i' : 'p', framerate);
+                    break;
 
-            if (mode==NULL)
-                dlexit("error: failed to find mode for %dx%d%c%.2f", pic_width, pic_height, interlaced? 'i' : 'p', framerate);
+                case 1:
+                    /* half-rate match, to support 1080p60 in a hacky way */
+                    halfframerate = true;
+                    framerate /= 2;
+                    video->framerate /= 2;
+                    break;
+            }
+            framerate_duration = mode.duration;
+            framerate_scale = mode.scale;
 
             /* display mode name */
-            const char *name = NULL;
-            if (mode->GetName(&name)==S_OK)
-                dlmessage("info: video mode %s %s", name, halfframerate?"(half rate)":"");
-            free((char *)name);
+            dlmessage("info: video mode %s %s", mode.name, halfframerate?"(half rate)":"");
         }
 
         /* vanc timecode enabled */
@@ -897,17 +1027,30 @@ int main(int argc, char *argv[])
 
         /* set the video output mode */
         if (video) {
-            /* inform allocator of frame size */
-            int32_t rowbytes;
-            if (pixelformat_is_8bit(pixelformat)) {
+            /* inform allocator and decoder of frame size */
+            if (pixelformat_is_8bit(pixelformat))
                 output->RowBytesForPixelFormat(bmdFormat8BitYUV, pic_width, &rowbytes);
-                alloc.init(rowbytes*pic_height);
-            } else {
+            else
                 output->RowBytesForPixelFormat(bmdFormat10BitYUV, pic_width, &rowbytes);
-                alloc.init(rowbytes*pic_height);
+            if (budget) {
+                /* the history buffer holds frames until the next is allocated, so
+                 * the budget has to cover it or allocation would wait forever */
+                size_t minimum = (size_t)(MAX_HISTORY_FRAMES+2)*rowbytes*pic_height;
+                if (budget<minimum)
+                    dlmessage("warning: memory budget of %zuMB is too small for %dx%d, using %zuMB", budget>>20, pic_width, pic_height, minimum>>20);
+                alloc.set_budget(mmax(budget, minimum));
             }
-
-            HRESULT result = output->EnableVideoOutput(mode->GetDisplayMode(), videoOutputFlags);
+            if (preallocate) {
+                /* enough buffers for the preroll and the history buffer */
+                alloc.init(rowbytes, pic_height, pixelformat, PREROLL_FRAMES+MAX_HISTORY_FRAMES, lockmemory);
+                if (verbose>=1 && alloc.preallocated())
+                    dlmessage("info: preallocated %d video buffers using %s on numa node %d", alloc.preallocated(), alloc.backing(), node_of_address(alloc.first()));
+            } else
+                alloc.init(rowbytes, pic_height, pixelformat);
+            video->set_rowbytes(rowbytes);
+            video->set_nontemporal(nontemporal);
+
+            HRESULT result = output->EnableVideoOutput(&mode, videoOutputFlags);
             if (result!=S_OK)
                 dlapierror(result, "failed to enable video output");
         }
@@ -934,7 +1077,7 @@ int main(int argc, char *argv[])
 
         /* preroll as many video frames as possible */
         preroll = 1;
-        IDeckLinkMutableVideoFrame *frame = NULL;
+        dlframe *frame = NULL;
         decode_t vid, aud;
         vid.timestamp = aud.timestamp = 0;      /* fixes warning */
 
@@ -951,11 +1094,17 @@ int main(int argc, char *argv[])
         /* video frame history buffer */
         int num_history_frames = 0;
         typedef struct {
-            IDeckLinkVideoFrame *frame;
+            dlframe *frame;
             sts_t timestamp;
         } history_frame_t;
         history_frame_t history_buffer[MAX_HISTORY_FRAMES] = {{NULL, 0ll}};
 
+        /* recover the encoder clock of a live transport stream, to hold the latency of the playout */
+        dlclock *clock = NULL;
+        if (live && demux && !freerun)
+            clock = new dlclock;
+        bool skip_wait = false;
+
         /* initialise terminal for user input */
 #ifdef USE_TERMIOS
         class dlterm term;
@@ -970,6 +1119,8 @@ int main(int argc, char *argv[])
         int blocknum = 0;
         unsigned long long queuetime = 0;
         unsigned long long decodetime = 0;
+        unsigned long long codectime = 0;
+        unsigned long long converttime = 0;
         while (!exit) {
 
             /* check for user input */
@@ -1080,7 +1231,10 @@ int main(int argc, char *argv[])
 #endif
 
             /* wait for callback after a frame is finished */
-            if (video && !preroll)
+            if (video && !preroll && skip_wait)
+                /* a frame was dropped to catch up with the encoder, don't wait */
+                skip_wait = false;
+            else if (video && !preroll)
                 /* use video callback to wait */
                 sem_wait(&sem);
             else if (audio && !video)
@@ -1088,17 +1242,41 @@ int main(int argc, char *argv[])
                 usleep(250000);
             /* else don't wait */
 
+            /* follow the encoder clock and, once playback has started, the output clock */
+            if (clock) {
+                long long pcr;
+                unsigned long long arrival;
+                while (demux->next_pcr(&pcr, &arrival))
+                    clock->add_pcr(pcr, arrival);
+                BMDTimeValue time;
+                double speed;
+                if (!preroll && output->GetScheduledStreamTime(180000, &time, &speed)==S_OK)
+                    clock->add_output(time, get_utime());
+                clock_locked = clock->locked();
+                clock_ratio = clock->ratio();
+                clock_repeated = clock->repeated;
+                clock_dropped = clock->dropped;
+            }
+
+            /* hold the latency by dropping a frame, or by leaving an empty slot so the last is repeated */
+            int adjust = 0;
+            if (frame && video && clock && !preroll)
+                adjust = clock->adjust_video(lround(180000.0/framerate), get_utime());
+            if (adjust<0)
+                skip_wait = true;
+
             /* enqueue previous frame */
-            if (frame && video) {
+            if (frame && video && adjust>=0) {
                 unsigned long long start = get_utime();
-                HRESULT result = output->ScheduleVideoFrame(frame, vid.timestamp, lround(180000.0/framerate), 180000);
+                sts_t timestamp = vid.timestamp + (clock? clock->offset : 0);
+                HRESULT result = output->ScheduleVideoFrame(frame, timestamp, lround(180000.0/framerate), 180000);
                 queuetime += get_utime() - start;
                 if (result != S_OK) {
                     switch (result) {
                         case E_ACCESSDENIED : fprintf(stderr, "%s: error: frame %d: video output disabled when queueing video frame\n", appname, queuenum); break;
                         case E_OUTOFMEMORY  : fprintf(stderr, "%s: error: frame %d: too many frames are scheduled when queueing video frame\n", appname, queuenum);
                         case E_INVALIDARG   : fprintf(stderr, "%s: error: frame %d: frame attributes are invalid when queueing video frame\n", appname, queuenum); break;
-                        default             : fprintf(stderr, "%s: error: frame %d: failed to schedule video frame, timestamp %s\n", appname, queuenum, describe_sts(vid.timestamp)); break;
+                        default             : fprintf(stderr, "%s: error: frame %d: failed to schedule video frame, timestamp %s\n", appname, queuenum, describe_sts(timestamp)); break;
                     }
                     break;
                 }
@@ -1148,13 +1326,14 @@ int main(int argc, char *argv[])
                 if (result!=S_OK)
                     dlapierror(result, "error: failed to allocate video buffer");
                 if (pixelformat_is_8bit(pixelformat))
-                    result = output->CreateVideoFrameWithBuffer(pic_width, pic_height, pic_width*2, bmdFormat8BitYUV, bmdFrameFlagDefault, buffer, &frame);
+                    result = output->CreateVideoFrameWithBuffer(pic_width, pic_height, rowbytes, bmdFormat8BitYUV, bmdFrameFlagDefault, buffer, &frame);
                 else
-                    result = output->CreateVideoFrameWithBuffer(pic_width, pic_height, ((pic_width+47)/48)*128, bmdFormat10BitYUV, bmdFrameFlagDefault, buffer, &frame);
+                    result = output->CreateVideoFrameWithBuffer(pic_width, pic_height, rowbytes, bmdFormat10BitYUV, bmdFrameFlagDefault, buffer, &frame);
                 if (result!=S_OK)
                     dlapierror(result, "error: failed to create video frame");
 
                 /* extract the frame buffer pointer without type punning */
+                void *voidptr;
                 result = buffer->GetBytes(&voidptr);
                 if (result!=S_OK)
                     dlapierror(result, "error: failed to get pointer to data in video frame");
@@ -1168,7 +1347,14 @@ int main(int argc, char *argv[])
                         restart = 1; /* wait for next sequence */
                     break;
                 }
+                network_dropped = source->dropped();
+                network_ring = source->ringstats();
+                network_lost = source->lost();
+                network_late = source->late();
+                network_recovered = source->recovered();
                 decodetime += get_utime() - start;
+                codectime += vid.decode_time;
+                converttime += vid.render_time;
                 video_start_time = mmin(vid.timestamp, video_start_time);
                 video_end_time = mmax(vid.timestamp, video_end_time);
 
@@ -1176,7 +1362,7 @@ int main(int argc, char *argv[])
                 set_timecode(frame,
                              framerate_scale,
                              framerate_duration,
-                             mode->GetFieldDominance() == bmdProgressiveFrame,
+                             mode.progressive,
                              &timecode,
                              reset_timecode);
                 reset_timecode = false;
@@ -1208,7 +1394,7 @@ int main(int argc, char *argv[])
                 /* reschedule audio that wasn't queued last time */
                 if (aud_rem>0) {
                     uint32_t scheduled;
-                    HRESULT result = output->ScheduleAudioSamples(aud_data+aud_size-aud_rem*4, aud_rem, aud.timestamp, 180000, &scheduled); // FIXME timestamp
+                    HRESULT result = output->ScheduleAudioSamples(aud_sched+(aud_frames-aud_rem)*4, aud_rem, aud_time, 180000, &scheduled); // FIXME timestamp
                     if (result != S_OK) {
                         dlmessage("error: block %d: failed to re-schedule audio data", blocknum);
                         delete audio;
@@ -1238,9 +1424,24 @@ int main(int argc, char *argv[])
                     }
                     audio_end_time = mmax(aud.timestamp, audio_end_time);
 
-                    /* buffer decoded audio */
+                    /* stretch the audio by a fraction of a sample to hold the latency */
                     uint32_t scheduled, num_sample_frames = aud.size/2;
-                    HRESULT result = output->ScheduleAudioSamples(aud_data, num_sample_frames, aud.timestamp, 180000, &scheduled);
+                    aud_sched = aud_data;
+                    aud_frames = num_sample_frames;
+                    aud_time = aud.timestamp;
+                    if (clock) {
+                        sts_t offset;
+                        int resampled = clock->adjust_audio(num_sample_frames, 48000, get_utime(), &offset);
+                        if (resampled!=(int)num_sample_frames) {
+                            resample_audio((int16_t *)aud_data, num_sample_frames, (int16_t *)aud_resampled, resampled, 2);
+                            aud_sched = aud_resampled;
+                            aud_frames = resampled;
+                        }
+                        aud_time += offset;
+                    }
+
+                    /* buffer decoded audio */
+                    HRESULT result = output->ScheduleAudioSamples(aud_sched, aud_frames, aud_time, 180000, &scheduled);
                     //dlmessage("buffer level %d: decoded %d bytes at timestamp %s and scheduled %d samples", buffered, aud.size, describe_sts(aud.timestamp), scheduled);
                     if (result != S_OK) {
                         dlmessage("error: block %d: failed to schedule audio data", blocknum);
@@ -1248,10 +1449,10 @@ int main(int argc, char *argv[])
                         audio = NULL;
                         break;
                     }
-                    if (scheduled!=num_sample_frames) {
-                        dlmessage("did not schedule all the audio data: %d/%d samples", scheduled, num_sample_frames);
+                    if (scheduled!=aud_frames) {
+                        dlmessage("did not schedule all the audio data: %d/%d samples", scheduled, aud_frames);
                         /* exit the loop with a note of how many sample frames remain */
-                        aud_rem = num_sample_frames - scheduled;
+                        aud_rem = aud_frames - scheduled;
                     }
                     blocknum++;
                 }
@@ -1326,10 +1527,9 @@ int main(int argc, char *argv[])
         output->DisableVideoOutput();
         if (audio)
             output->DisableAudioOutput();
-        mode->Release();
 
         /* release all frames in the history buffer */
-        for (i=0; i<num_history_frames; i++)
+        for (int i=0; i<num_history_frames; i++)
             if (history_buffer[i].frame)
                 history_buffer[i].frame->Release();
 
@@ -1339,11 +1539,15 @@ int main(int argc, char *argv[])
         /* report timing statistics */
         if (verbose>=1)
             dlmessage("\nmean decode time=%.2fms, mean render time=%.2fms (frame period %.2fms)", (decodetime/framenum)/1000.0, (queuetime/queuenum)/1000.0, 1000.0/framerate);
+        if (verbose>=1 && framenum)
+            dlmessage("mean codec time=%.2fms, mean convert time=%.2fms with %s stores", (codectime/framenum)/1000.0, (converttime/framenum)/1000.0, nontemporal? "non-temporal" : "cached");
 
         /* tidy up */
         delete source;
         delete vid_fmt;
         delete aud_fmt;
+        delete clock;
+        delete demux;
         delete video;
         delete audio;
     }
@@ -1353,16 +1557,31 @@ int main(int argc, char *argv[])
     pthread_join(status_thread, NULL);
 
     /* tidy up */
-    output->Release();
-    config->Release();
-    card->Release();
-    iterator->Release();
+    delete output;
     if (aud_data)
         free(aud_data);
+    free(aud_resampled);
+    convert_set_threads(1);
 
     /* report statistics */
     if (verbose>=0)
         dlmessage("%d frames: %d late, %d dropped, %d flushed", completed, late, dropped, flushed);
+    if (verbose>=0 && network_dropped)
+        dlmessage("%llu datagrams dropped by the network socket", network_dropped);
+    if (verbose>=0 && (network_lost || network_late))
+        dlmessage("%llu rtp packets lost, %llu too late to reorder", network_lost, network_late);
+    if (verbose>=0 && network_recovered)
+        dlmessage("%llu rtp packets recovered by fec, %llu unrecoverable", network_recovered, network_lost);
+    if (verbose>=0 && (clock_repeated || clock_dropped))
+        dlmessage("%llu frames repeated and %llu dropped to follow the encoder clock, %+.1fppm from the output clock", clock_repeated, clock_dropped, (clock_ratio-1.0)*1e6);
+    if (verbose>=0 && network_ring.overflows)
+        dlmessage("%llu datagrams discarded by the network receive ring", network_ring.overflows);
+    if (verbose>=0 && network_ring.truncated)
+        dlmessage("%llu datagrams larger than %d bytes truncated", network_ring.truncated, SOCK_SLOTSIZE);
+    if (verbose>=1 && network_ring.depth)
+        dlmessage("network receive ring: %u datagrams, high watermark %u", network_ring.depth, network_ring.watermark);
+    if (verbose>=1)
+        dlmessage("video buffers: %llu allocated, %llu reused, %llu contended, %llu blocked, %zuMB held", alloc.allocated(), alloc.reused(), alloc.contended(), alloc.blocked(), alloc.bytes()>>20);
 
     return 0;
 }
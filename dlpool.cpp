@@ -0,0 +1,99 @@
+/*
+ * Description: worker thread pool for slice-parallel processing
+ * Author     : Ryan Dalzell
+ * Copyright  : (c) 2026 4i2i Communications Ltd.
+ */
+
+#include "dlutil.h"
+#include "dlpool.h"
+
+dlpool::dlpool(int threads)
+{
+    numthreads = mmax(1, mmin(threads, MAX_POOL_THREADS));
+    quit = false;
+    job = NULL;
+    arg = NULL;
+    rows = 0;
+    granularity = 1;
+    sem_init(&done, 0, 0);
+
+    /* the calling thread runs the first band, so start one less worker */
+    for (int i=1; i<numthreads; i++) {
+        workers[i].pool = this;
+        workers[i].index = i;
+        sem_init(&workers[i].start, 0, 0);
+        if (pthread_create(&workers[i].thread, NULL, worker, &workers[i])!=0)
+            dlexit("failed to create conversion worker thread %d", i);
+    }
+}
+
+dlpool::~dlpool()
+{
+    quit = true;
+    for (int i=1; i<numthreads; i++)
+        sem_post(&workers[i].start);
+    for (int i=1; i<numthreads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        sem_destroy(&workers[i].start);
+    }
+    sem_destroy(&done);
+}
+
+void dlpool::band(int index, int *first, int *last) const
+{
+    /* divide the rows in whole units of granularity, spreading the remainder */
+    int units = (rows+granularity-1) / granularity;
+    int base = units / numthreads;
+    int extra = units % numthreads;
+    int start = index*base + mmin(index, extra);
+    int count = base + (index<extra? 1 : 0);
+    *first = mmin(start*granularity, rows);
+    *last = mmin((start+count)*granularity, rows);
+}
+
+void *dlpool::worker(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    dlpool *pool = w->pool;
+
+    while (1) {
+        sem_wait(&w->start);
+        if (pool->quit)
+            break;
+
+        int first, last;
+        pool->band(w->index, &first, &last);
+        if (first<last)
+            pool->job(pool->arg, first, last);
+
+        sem_post(&pool->done);
+    }
+
+    return NULL;
+}
+
+void dlpool::run(band_job_t job, void *arg, int rows, int granularity)
+{
+    /* small jobs are not worth the handoff */
+    if (numthreads==1 || rows<=granularity) {
+        job(arg, 0, rows);
+        return;
+    }
+
+    this->job = job;
+    this->arg = arg;
+    this->rows = rows;
+    this->granularity = mmax(granularity, 1);
+
+    /* semaphores order the job parameters before the workers read them */
+    for (int i=1; i<numthreads; i++)
+        sem_post(&workers[i].start);
+
+    int first, last;
+    band(0, &first, &last);
+    if (first<last)
+        job(arg, first, last);
+
+    for (int i=1; i<numthreads; i++)
+        sem_wait(&done);
+}
@@ -0,0 +1,47 @@
+#ifndef DLPOOL_H
+#define DLPOOL_H
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#define MAX_POOL_THREADS 64
+
+/* band job, converts rows first to last-1 of a frame */
+typedef void (*band_job_t)(void *arg, int first, int last);
+
+/* persistent pool of worker threads for splitting a frame into bands */
+class dlpool
+{
+public:
+    dlpool(int threads);
+    ~dlpool();
+
+    int size() const { return numthreads; }
+
+    /* run a job over rows split into bands with boundaries at multiples of granularity */
+    void run(band_job_t job, void *arg, int rows, int granularity);
+
+private:
+    struct worker_t {
+        dlpool *pool;
+        int index;
+        pthread_t thread;
+        sem_t start;
+    };
+
+    static void *worker(void *arg);
+    void band(int index, int *first, int *last) const;
+
+    int numthreads;
+    worker_t workers[MAX_POOL_THREADS];
+    sem_t done;
+    bool quit;
+
+    /* current job */
+    band_job_t job;
+    void *arg;
+    int rows;
+    int granularity;
+};
+
+#endif
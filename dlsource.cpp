@@ -12,10 +12,20 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/select.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <time.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <linux/fs.h>
+#ifdef HAVE_IO_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
 
 #include "dlutil.h"
 #include "dlsource.h"
+#include "dlkernel.h"
 
 using namespace std;
 
@@ -222,12 +232,15 @@ bool dlfile::error(dltoken_t t)
 /* memory mapped file source class */
 dlmmap::dlmmap()
 {
-    ptr = NULL;
+    addr = NULL;
+    length = 0;
+    released = 0;
 }
 
 dlmmap::~dlmmap()
 {
-    munmap(addr, length);
+    if (addr)
+        munmap(addr, length);
 }
 
 int dlmmap::open(const char *f)
@@ -242,27 +255,80 @@ int dlmmap::open(const char *f)
     addr = (unsigned char *)mmap(NULL, length, PROT_READ, MAP_PRIVATE, file[0], 0);
     if (addr==MAP_FAILED)
         dlerror("error: failed to memory map input file \"%s\"", filename);
-    ptr = addr;
+
+    /* readers are sequential, prefetching is done explicitly in windows */
+    madvise(addr, length, MADV_SEQUENTIAL);
+
+    cursor.push_back(0);
+    ahead.push_back(0);
+    active.push_back(0);
 
     return 0;
 }
 
+dltoken_t dlmmap::attach()
+{
+    /* readers share the mapping */
+    cursor.push_back(0);
+    ahead.push_back(0);
+    active.push_back(0);
+    eof_flag.push_back(0);
+    error_flag.push_back(0);
+
+    return (dltoken_t) cursor.size()-1;
+}
+
 int dlmmap::rewind(dltoken_t t)
 {
-    ptr = addr;
+    cursor[t] = 0;
+    ahead[t] = 0;
+    active[t] = 0;
+    eof_flag[t] = 0;
+
+    /* released pages are faulted in again from the page cache */
+    released = 0;
 
     return 0;
 }
 
+/* move the read-ahead window of a reader and release pages behind the slowest reader */
+void dlmmap::advise(dltoken_t t)
+{
+    const size_t page = 4096;
+    active[t] = 1;
+
+    /* prefetch a window ahead of the reader when it is half way through the last one */
+    if (cursor[t]+MMAP_WINDOW/2>ahead[t] && ahead[t]<length) {
+        size_t start = mmax(ahead[t], cursor[t]) & ~(page-1);
+        size_t end = mmin(cursor[t]+MMAP_WINDOW, length);
+        madvise(addr+start, end-start, MADV_WILLNEED);
+        ahead[t] = end;
+
+        /* the slowest reader which is still reading */
+        size_t slowest = length;
+        for (unsigned i=0; i<cursor.size(); i++)
+            if (active[i])
+                slowest = mmin(slowest, cursor[i]);
+        slowest &= ~(page-1);
+        if (slowest>=released+MMAP_WINDOW) {
+            madvise(addr+released, slowest-released, MADV_DONTNEED);
+            released = slowest;
+        }
+    }
+}
+
 /* read with copy */
 size_t dlmmap::read(unsigned char *buf, size_t bytes, dltoken_t t)
 {
-    if (ptr+bytes>addr+length)
-        bytes = addr+length-ptr;
+    if (cursor[t]+bytes>length)
+        bytes = length-cursor[t];
+    if (bytes==0)
+        eof_flag[t] = 1;
 
     /* kind of defeats the point of mmap */
-    memcpy(buf, ptr, bytes);
-    ptr += bytes;
+    memcpy(buf, addr+cursor[t], bytes);
+    cursor[t] += bytes;
+    advise(t);
 
     return bytes;
 }
@@ -270,10 +336,13 @@ size_t dlmmap::read(unsigned char *buf, size_t bytes, dltoken_t t)
 /* zero copy read using memory mapped pointer */
 const unsigned char *dlmmap::read(size_t *bytes, dltoken_t t)
 {
-    const unsigned char *ret = ptr;
-    if (ptr+*bytes>addr+length)
-        *bytes = addr+length-ptr;
-    ptr += *bytes;
+    const unsigned char *ret = addr+cursor[t];
+    if (cursor[t]+*bytes>length)
+        *bytes = length-cursor[t];
+    if (*bytes==0)
+        eof_flag[t] = 1;
+    cursor[t] += *bytes;
+    advise(t);
 
     return ret;
 }
@@ -285,12 +354,12 @@ size_t dlmmap::size()
 
 off_t dlmmap::pos(dltoken_t t)
 {
-    return ptr-addr;
+    return cursor[t];
 }
 
 bool dlmmap::eof(dltoken_t t)
 {
-    return ptr>=addr+length;
+    return cursor[t]>=length;
 }
 
 bool dlmmap::error(dltoken_t t)
@@ -298,12 +367,574 @@ bool dlmmap::error(dltoken_t t)
     return 0;
 }
 
+/* asynchronous read-ahead file source class */
+enum { CHUNK_IDLE, CHUNK_PENDING, CHUNK_READY, CHUNK_ERROR };
+
+#ifdef HAVE_IO_URING
+/* io_uring submission and completion queues, mapped from the kernel */
+struct ring_t {
+    int fd;
+    unsigned entries;
+    unsigned inflight;
+
+    void *sq, *cq;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned *sq_tail, *sq_array, sq_mask;
+    unsigned *cq_head, *cq_tail, cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+};
+
+static void ring_close(ring_t *ring)
+{
+    if (ring->sq!=MAP_FAILED)
+        munmap(ring->sq, ring->sq_size);
+    if (ring->cq!=MAP_FAILED)
+        munmap(ring->cq, ring->cq_size);
+    if (ring->sqes!=MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_size);
+    close(ring->fd);
+    delete ring;
+}
+
+/* the kernel supports an operation on the ring */
+static bool ring_supports(ring_t *ring, unsigned op)
+{
+    size_t size = sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, size);
+    if (!probe)
+        return false;
+    bool supported = false;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256)==0)
+        supported = op<probe->ops_len && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return supported;
+}
+
+static ring_t *ring_open(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd<0)
+        return NULL;
+
+    ring_t *ring = new ring_t;
+    ring->fd = fd;
+    ring->entries = p.sq_entries;
+    ring->inflight = 0;
+
+    /* map the rings and the submission queue entries */
+    ring->sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    ring->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+    ring->sq = mmap(NULL, ring->sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cq = mmap(NULL, ring->cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sq==MAP_FAILED || ring->cq==MAP_FAILED || ring->sqes==MAP_FAILED) {
+        ring_close(ring);
+        return NULL;
+    }
+
+    unsigned char *sq = (unsigned char *)ring->sq;
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    unsigned char *cq = (unsigned char *)ring->cq;
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    /* kernels before 5.6 set up a ring but fail plain reads, and cannot be probed either */
+    if (!ring_supports(ring, IORING_OP_READ)) {
+        ring_close(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+static int ring_enter(ring_t *ring, unsigned submit, unsigned wait)
+{
+    int r;
+    do
+        r = syscall(__NR_io_uring_enter, ring->fd, submit, wait, wait? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    while (r<0 && errno==EINTR);
+    return r;
+}
+#endif
+
+dluring::dluring(int d, size_t c)
+{
+    depth = mmax(2, mmin(d, MAX_READAHEAD));
+    /* reads are aligned to the page size */
+    chunksize = (c + 4095) & ~(size_t)4095;
+    align = 1;
+    ring = NULL;
+}
+
+dluring::~dluring()
+{
+    /* wait for reads in flight before freeing their buffers */
+#ifdef HAVE_IO_URING
+    if (ring) {
+        while (ring->inflight)
+            complete(true);
+        ring_close(ring);
+    }
+#endif
+    for (unsigned t=0; t<window.size(); t++) {
+        if (window[t]==NULL)
+            continue;
+        for (int c=0; c<depth; c++)
+            free(window[t]->chunk[c].data);
+        delete window[t];
+    }
+}
+
+int dluring::open(const char *f)
+{
+    /* open the input file */
+    dlfile::open(f);
+    start();
+
+    return 0;
+}
+
+dltoken_t dluring::attach()
+{
+    dltoken_t t = dlfile::attach();
+    window.push_back(NULL);
+
+    return t;
+}
+
+void dluring::start()
+{
+#ifdef HAVE_IO_URING
+    /* fall back to synchronous reads if io_uring is not supported by the kernel */
+    ring = ring_open(128);
+#endif
+
+    /* the window of a reader is set up on its first read */
+    window.push_back(NULL);
+}
+
+void dluring::set_readsize(size_t bytes)
+{
+    /* only before any reader has started */
+    for (unsigned t=0; t<window.size(); t++)
+        if (window[t])
+            return;
+
+    /* a read is rounded up to the alignment, so a frame is only one whole read when its size is a multiple of it */
+    chunksize = (bytes + align-1) / align * align;
+}
+
+int dluring::locate(dltoken_t t, off_t offset, off_t *physical)
+{
+    *physical = offset;
+    return file[t];
+}
+
+void dluring::setup(dltoken_t t)
+{
+    /* buffers are aligned to the page size */
+    size_t alloc = (chunksize + 4095) & ~(size_t)4095;
+    window_t *w = new window_t;
+    for (int c=0; c<depth; c++) {
+        if (posix_memalign((void **)&w->chunk[c].data, 4096, alloc))
+            dlexit("failed to allocate read-ahead buffer of %zu bytes", alloc);
+        w->chunk[c].state = CHUNK_IDLE;
+    }
+    window[t] = w;
+
+    /* fill the window from the start of the file */
+    w->next = 0;
+    for (int c=0; c<depth; c++)
+        submit(t, c);
+    w->current = 0;
+    w->used = 0;
+    w->position = 0;
+    w->consumed = false;
+}
+
+/* submit the read of the next chunk of the file into a chunk of the window */
+void dluring::submit(dltoken_t t, int c)
+{
+    window_t *w = window[t];
+    chunk_t *chunk = &w->chunk[c];
+    chunk->offset = w->next;
+    chunk->length = 0;
+    chunk->state = CHUNK_PENDING;
+    chunk->retried = false;
+    w->next += chunksize;
+
+    off_t physical;
+    int fd = locate(t, chunk->offset, &physical);
+
+#ifdef HAVE_IO_URING
+    if (ring) {
+        /* make room in the submission queue */
+        while (ring->inflight>=ring->entries)
+            complete(true);
+
+        unsigned tail = *ring->sq_tail;
+        unsigned index = tail & ring->sq_mask;
+        struct io_uring_sqe *sqe = &ring->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->off = physical;
+        sqe->addr = (unsigned long)chunk->data;
+        sqe->len = chunksize;
+        sqe->user_data = ((unsigned long long)t << 8) | c;
+        ring->sq_array[index] = index;
+        __atomic_store_n(ring->sq_tail, tail+1, __ATOMIC_RELEASE);
+        ring->inflight++;
+
+        if (ring_enter(ring, 1, 0)<0)
+            dlerror("failed to submit read of input file \"%s\"", filename);
+        return;
+    }
+#endif
+
+    /* synchronous read of the whole chunk */
+    while (chunk->length<chunksize) {
+        ssize_t r = pread(fd, chunk->data+chunk->length, chunksize-chunk->length, physical+chunk->length);
+        if (r<0 && errno==EINVAL && !chunk->retried && fall_back()) {
+            chunk->retried = true;
+            continue;
+        }
+        if (r<0) {
+            chunk->state = CHUNK_ERROR;
+            return;
+        }
+        if (r==0)
+            break;
+        chunk->length += r;
+        /* an unaligned short read is the end of a file opened for direct i/o */
+        if (chunk->length%align)
+            break;
+    }
+    chunk->state = CHUNK_READY;
+}
+
+/* reap completed reads, optionally waiting for at least one */
+void dluring::complete(bool wait)
+{
+#ifdef HAVE_IO_URING
+    if (!ring || ring->inflight==0)
+        return;
+
+    unsigned head = *ring->cq_head;
+    if (wait && head==__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        if (ring_enter(ring, 0, 1)<0)
+            dlerror("failed to wait for read of input file \"%s\"", filename);
+
+    unsigned resubmit = 0;
+    while (head!=__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        dltoken_t t = cqe->user_data >> 8;
+        chunk_t *chunk = &window[t]->chunk[cqe->user_data & 0xff];
+        int res = cqe->res;
+        head++;
+        ring->inflight--;
+
+        bool retry = res==-EINVAL && !chunk->retried && fall_back();
+        if (retry)
+            chunk->retried = true;
+
+        if (res<0 && !retry) {
+            errno = -res;
+            chunk->state = CHUNK_ERROR;
+        } else if (retry || (res>0 && chunk->length+res<chunksize && (chunk->length+res)%align==0)) {
+            /* continue a short read or retry a refused one in the same chunk, a read of zero bytes marks the end of file */
+            if (res>0)
+                chunk->length += res;
+            off_t physical;
+            int fd = locate(t, chunk->offset, &physical);
+            unsigned tail = *ring->sq_tail;
+            unsigned index = tail & ring->sq_mask;
+            struct io_uring_sqe *sqe = &ring->sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->off = physical + chunk->length;
+            sqe->addr = (unsigned long)(chunk->data + chunk->length);
+            sqe->len = chunksize - chunk->length;
+            sqe->user_data = cqe->user_data;
+            ring->sq_array[index] = index;
+            __atomic_store_n(ring->sq_tail, tail+1, __ATOMIC_RELEASE);
+            ring->inflight++;
+            resubmit++;
+        } else {
+            chunk->length += res;
+            chunk->state = CHUNK_READY;
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    if (resubmit && ring_enter(ring, resubmit, 0)<0)
+        dlerror("failed to submit read of input file \"%s\"", filename);
+#endif
+}
+
+/* wait for the current chunk of a reader, returns null at end of file */
+dluring::chunk_t *dluring::ready(dltoken_t t)
+{
+    if (window[t]==NULL)
+        setup(t);
+    window_t *w = window[t];
+
+    /* resubmit a chunk consumed by the previous zero copy read */
+    if (w->consumed) {
+        w->consumed = false;
+        advance(t);
+    }
+
+    chunk_t *chunk = &w->chunk[w->current];
+    while (chunk->state==CHUNK_PENDING)
+        complete(true);
+    if (chunk->state==CHUNK_ERROR) {
+        error_flag[t] = 1;
+        dlerror("error: failed to read from input file \"%s\"", filename);
+    }
+    if (w->used>=chunk->length) {
+        eof_flag[t] = 1;
+        return NULL;
+    }
+
+    return chunk;
+}
+
+/* move a reader to the next chunk of its window, reusing the current chunk for read-ahead */
+void dluring::advance(dltoken_t t)
+{
+    window_t *w = window[t];
+    submit(t, w->current);
+    w->current = (w->current+1) % depth;
+    w->used = 0;
+}
+
+int dluring::rewind(dltoken_t t)
+{
+    eof_flag[t] = 0;
+    if (window[t]==NULL)
+        return 0;
+    window_t *w = window[t];
+
+    /* wait for reads in flight of this reader */
+    for (int c=0; c<depth; c++)
+        while (w->chunk[c].state==CHUNK_PENDING)
+            complete(true);
+
+    /* refill the window from the start of the file */
+    w->next = 0;
+    for (int c=0; c<depth; c++)
+        submit(t, c);
+    w->current = 0;
+    w->used = 0;
+    w->position = 0;
+    w->consumed = false;
+
+    return 0;
+}
+
+/* read with copy from the read-ahead window */
+size_t dluring::read(unsigned char *buf, size_t bytes, dltoken_t t)
+{
+    size_t read = 0;
+    while (read<bytes) {
+        chunk_t *chunk = ready(t);
+        if (chunk==NULL)
+            break;
+        window_t *w = window[t];
+
+        size_t n = mmin(bytes-read, chunk->length-w->used);
+        memcpy(buf+read, chunk->data+w->used, n);
+        w->used += n;
+        w->position += n;
+        read += n;
+
+        if (w->used==chunk->length)
+            advance(t);
+    }
+
+    return read;
+}
+
+/* zero copy read from the read-ahead window, unless the read spans chunks */
+const unsigned char *dluring::read(size_t *bytes, dltoken_t t)
+{
+    chunk_t *chunk = ready(t);
+    if (chunk==NULL) {
+        *bytes = 0;
+        return buffer;
+    }
+    window_t *w = window[t];
+
+    size_t left = chunk->length - w->used;
+    if (*bytes==0)
+        *bytes = left;
+    if (*bytes<=left) {
+        /* the chunk is resubmitted on the next read, once the caller is done with it */
+        const unsigned char *ret = chunk->data + w->used;
+        w->used += *bytes;
+        w->position += *bytes;
+        if (w->used==chunk->length)
+            w->consumed = true;
+        return ret;
+    }
+
+    /* gather the chunks into the internal buffer */
+    checksize(*bytes);
+    *bytes = read(buffer, *bytes, t);
+
+    return buffer;
+}
+
+off_t dluring::pos(dltoken_t t)
+{
+    return window[t]? window[t]->position : 0;
+}
+
+/* direct i/o file source class */
+dldirect::dldirect(int d) : dluring(d)
+{
+    /* direct i/o needs the offset and length of reads aligned to the logical block size, found when the files are opened */
+    align = 512;
+    direct = true;
+}
+
+dldirect::~dldirect()
+{
+    for (unsigned i=0; i<stripes.size(); i++)
+        free(stripes[i]);
+}
+
+int dldirect::open(const char *names)
+{
+    filename = names;
+
+    /* split the list of stripes */
+    char *list = strdup(names);
+    for (char *name=strtok(list, ","); name; name=strtok(NULL, ","))
+        stripes.push_back(strdup(name));
+    free(list);
+    if (stripes.empty())
+        dlexit("error: no input files in \"%s\"", names);
+
+    open_stripes();
+    chunksize = (chunksize + align-1) / align * align;
+    start();
+
+    return 0;
+}
+
+dltoken_t dldirect::attach()
+{
+    open_stripes();
+    window.push_back(NULL);
+
+    return (dltoken_t) eof_flag.size()-1;
+}
+
+/* alignment of direct i/o to a file, the logical block size of its device */
+static size_t direct_alignment(int fd)
+{
+#ifdef STATX_DIOALIGN
+    struct statx stx;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx)==0 && (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align)
+        return stx.stx_dio_offset_align;
+#endif
+    struct stat st;
+    int size;
+    if (fstat(fd, &st)==0 && S_ISBLK(st.st_mode) && ioctl(fd, BLKSSZGET, &size)==0 && size>0)
+        return size;
+
+    /* otherwise the largest logical block size in common use */
+    return 4096;
+}
+
+void dldirect::open_stripes()
+{
+    for (unsigned i=0; i<stripes.size(); i++) {
+        int f = ::open(stripes[i], O_RDONLY | O_LARGEFILE | O_DIRECT);
+        if (f<0 && errno==EINVAL) {
+            /* not supported by the filesystem */
+            if (eof_flag.empty())
+                dlmessage("warning: direct i/o is not supported for input file \"%s\"", stripes[i]);
+            f = ::open(stripes[i], O_RDONLY | O_LARGEFILE);
+        }
+        if (f<0)
+            dlerror("error: failed to open input file \"%s\"", stripes[i]);
+        file.push_back(f);
+
+        /* reads are aligned for every stripe */
+        if (eof_flag.empty())
+            align = mmax(align, direct_alignment(f));
+    }
+    eof_flag.push_back(0);
+    error_flag.push_back(0);
+}
+
+size_t dldirect::size()
+{
+    size_t size = 0;
+    for (unsigned i=0; i<stripes.size(); i++) {
+        struct stat stat;
+        fstat(file[i], &stat);
+        size += stat.st_size;
+    }
+
+    return size;
+}
+
+void dldirect::set_readsize(size_t bytes)
+{
+    /* frames would straddle the stripes unless they fill whole blocks */
+    if (stripes.size()>1 && bytes%align)
+        dlexit("error: frame size of %zu bytes is not a multiple of the %zu byte block size of direct i/o, which is needed to read stripes of frames", bytes, align);
+
+    dluring::set_readsize(bytes);
+}
+
+bool dldirect::fall_back()
+{
+    /* the files are read through the page cache from now on, with the same layout */
+    if (direct) {
+        dlmessage("warning: direct i/o was refused for input file \"%s\", reading through the page cache", filename);
+        for (unsigned i=0; i<file.size(); i++)
+            fcntl(file[i], F_SETFL, fcntl(file[i], F_GETFL) & ~O_DIRECT);
+        direct = false;
+    }
+
+    return true;
+}
+
+int dldirect::locate(dltoken_t t, off_t offset, off_t *physical)
+{
+    /* stripe i holds reads i, i+n, i+2n... of the stream */
+    unsigned n = stripes.size();
+    off_t index = offset / chunksize;
+    *physical = (index / n) * chunksize;
+
+    return file[t*n + index%n];
+}
+
 /* network socket source class */
 dlsock::dlsock()
 {
     sock = -1;
     multicast = NULL;
     interface = NULL;
+    msgs = NULL;
+    depth = SOCK_SLOTS;
+    threaded = false;
+    drops = overflows = truncated = 0;
+    arrived = 0;
 }
 
 dlsock::dlsock(const char *a)
@@ -311,6 +942,11 @@ dlsock::dlsock(const char *a)
     sock = -1;
     multicast = a;
     interface = NULL;
+    msgs = NULL;
+    depth = SOCK_SLOTS;
+    threaded = false;
+    drops = overflows = truncated = 0;
+    arrived = 0;
 }
 
 dlsock::dlsock(const char *a, const char *i)
@@ -318,12 +954,30 @@ dlsock::dlsock(const char *a, const char *i)
     sock = -1;
     multicast = a;
     interface = i;
+    msgs = NULL;
+    depth = SOCK_SLOTS;
+    threaded = false;
+    drops = overflows = truncated = 0;
+    arrived = 0;
 }
 
 dlsock::~dlsock()
 {
+    if (threaded) {
+        __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+        pthread_join(thread, NULL);
+        pthread_mutex_destroy(&mutex);
+        pthread_cond_destroy(&cond);
+    }
     if (sock>=0)
         close(sock);
+    if (msgs) {
+        free(slots);
+        free(msgs);
+        free(iov);
+        free(control);
+        free(arrivals);
+    }
 }
 
 int dlsock::open(const char *port)
@@ -385,6 +1039,43 @@ int dlsock::open(const char *port)
             dlerror("failed to send add membership message");
     }
 
+    /* report datagrams dropped by the kernel with each receive */
+    int enable = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable))<0)
+        dlmessage("warning: failed to enable socket drop counter");
+
+    /* stamp each datagram with its time of arrival, for clock recovery */
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable))<0)
+        dlmessage("warning: failed to enable socket timestamps");
+
+    /* set up the ring of datagram slots, followed by a batch of messages
+     * which all receive into one extra slot to discard datagrams when the ring is full */
+    slots = (unsigned char *) malloc((depth+1)*SOCK_SLOTSIZE);
+    msgs = (struct mmsghdr *) calloc(depth+SOCK_SLOTS, sizeof(struct mmsghdr));
+    iov = (struct iovec *) calloc(depth+SOCK_SLOTS, sizeof(struct iovec));
+    control = (unsigned char *) malloc((depth+SOCK_SLOTS)*SOCK_CONTROLSIZE);
+    arrivals = (unsigned long long *) calloc(depth+SOCK_SLOTS, sizeof(unsigned long long));
+    for (unsigned i=0; i<depth+SOCK_SLOTS; i++) {
+        iov[i].iov_base = slots + mmin(i, depth)*SOCK_SLOTSIZE;
+        iov[i].iov_len = SOCK_SLOTSIZE;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = control + i*SOCK_CONTROLSIZE;
+    }
+    head = tail = 0;
+    offset = 0;
+    watermark = 0;
+
+    /* start draining the socket */
+    if (threaded) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&cond, NULL);
+        waiting = 0;
+        running = true;
+        if (pthread_create(&thread, NULL, receive_thread, this)!=0)
+            dlexit("failed to create network receive thread");
+    }
+
     /* user feedback */
     if (multicast && interface)
         dlmessage("listening for multicast data from encoder on group %s on interface %s and port %s", multicast, interface, port);
@@ -437,71 +1128,227 @@ dltoken_t dlsock::attach()
     return (dltoken_t) 0;
 }
 
-size_t dlsock::read(unsigned char *buf, size_t bytes, dltoken_t t)
+void dlsock::set_ring(unsigned d)
 {
-    /* check internal buffer is large enough */
-    checksize(bytes);
+    /* a power of two so the ring indices can wrap */
+    if (d==0) {
+        depth = SOCK_SLOTS;
+        threaded = false;
+    } else {
+        for (depth=SOCK_SLOTS; depth<d; depth*=2);
+        threaded = true;
+    }
+}
 
-    timed_out = 0;
-    if (time_out) {
-        /* wait until socket is ready, with timeout */
-        fd_set rfds;
-        struct timeval tv = { 0, (long)time_out };
-        FD_ZERO(&rfds);
-        FD_SET(sock, &rfds);
-        int r = select(sock+1, &rfds, NULL, NULL, &tv);
-        if (r<0)
-            dlerror("error: failed to select on network socket");
-        if (r==0) {
-            dlmessage("timeout on network socket read");
-            timed_out = 1;
-            return -1;
+/* receive a batch of datagrams into consecutive messages, returns zero if none are waiting */
+int dlsock::receive(unsigned first, unsigned count, int flags)
+{
+    for (unsigned i=first; i<first+count; i++) {
+        msgs[i].msg_hdr.msg_controllen = SOCK_CONTROLSIZE;
+        msgs[i].msg_hdr.msg_flags = 0;
+    }
+    int n = recvmmsg(sock, msgs+first, count, flags, NULL);
+    if (n<0) {
+        if (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)
+            return 0;
+        dlerror("error: failed to read from socket");
+    }
+
+    unsigned long long now = n>0? get_utime() : 0;
+    for (unsigned i=first; i<first+n; i++) {
+        /* counted rather than reported each time, this may be the receive thread */
+        if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+            if (__atomic_add_fetch(&truncated, 1, __ATOMIC_RELAXED)==1)
+                dlmessage("warning: datagram larger than %d bytes truncated", SOCK_SLOTSIZE);
+
+        /* the drop counter is the total since the socket was opened,
+         * the kernel timestamp is the same clock as get_utime */
+        arrivals[i] = now;
+        for (struct cmsghdr *cmsg=CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg; cmsg=CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg))
+            if (cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SO_RXQ_OVFL) {
+                uint32_t count;
+                memcpy(&count, CMSG_DATA(cmsg), sizeof(count));
+                __atomic_store_n(&drops, count, __ATOMIC_RELAXED);
+            } else if (cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SCM_TIMESTAMP) {
+                struct timeval tv;
+                memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+                arrivals[i] = tv.tv_sec*1000000ll + tv.tv_usec;
+            }
+    }
+
+    return n;
+}
+
+void *dlsock::receive_thread(void *arg)
+{
+    dlsock *s = (dlsock *)arg;
+    s->run_receive();
+    return NULL;
+}
+
+/* receive thread, the single producer of the ring */
+void dlsock::run_receive()
+{
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        /* wake periodically to check for exit */
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        int r = poll(&pfd, 1, 100);
+        if (r<0 && errno!=EINTR)
+            dlerror("error: failed to poll network socket");
+        if (r<=0)
+            continue;
+
+        unsigned h = head;
+        unsigned t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        unsigned space = depth - (h-t);
+        if (space==0) {
+            /* keep draining the socket, the reader is too slow */
+            int n = receive(depth, SOCK_SLOTS, MSG_DONTWAIT);
+            __atomic_add_fetch(&overflows, n, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        /* receive into the free slots up to the end of the ring */
+        unsigned index = h & (depth-1);
+        unsigned count = mmin(mmin(space, depth-index), SOCK_SLOTS);
+        int n = receive(index, count, MSG_DONTWAIT);
+        if (n==0)
+            continue;
+
+        /* publish the datagrams and wake the reader if it is waiting */
+        __atomic_store_n(&head, h+n, __ATOMIC_SEQ_CST);
+        if (h+n-t>__atomic_load_n(&watermark, __ATOMIC_RELAXED))
+            __atomic_store_n(&watermark, h+n-t, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&waiting, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_lock(&mutex);
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&mutex);
         }
     }
+}
 
-    /* fill internal buffer */
-    if (bytes>bytesleft) {
-        if (bytesleft==0)
-            bufptr = buffer;
-        else if (bytesleft>0 && bytesleft<bufsize) {
-            memmove(buffer, bufptr, bytesleft);
-            bufptr = buffer;
+/* wait for datagrams after those seen by the reader, or receive them without a receive thread */
+int dlsock::refill(unsigned seen)
+{
+    timed_out = 0;
+
+    if (threaded) {
+        struct timespec deadline;
+        if (time_out) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)time_out*1000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
         }
 
-        /* calculate number of bytes to refill buffer */
-        size_t fill = bufsize-bytesleft;
-
-        /* refill buffer */
-        size_t read = recvfrom(sock, buffer, fill, MSG_TRUNC, NULL, 0);
-        if (read<0)
-            dlerror("error: failed to read from socket");
-        else if (read==0)
-            dlmessage("zero sized packet received");
-        else if (read>fill) {
-            dlmessage("warning: %d bytes discarded", read-fill);
-            read = fill;
+        pthread_mutex_lock(&mutex);
+        __atomic_store_n(&waiting, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&head, __ATOMIC_SEQ_CST)==seen && !timed_out) {
+            if (time_out==0)
+                pthread_cond_wait(&cond, &mutex);
+            else if (pthread_cond_timedwait(&cond, &mutex, &deadline)==ETIMEDOUT)
+                timed_out = 1;
+        }
+        __atomic_store_n(&waiting, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&mutex);
+    } else {
+        if (time_out) {
+            /* wait until socket is ready, with timeout */
+            fd_set rfds;
+            struct timeval tv = { 0, (long)time_out };
+            FD_ZERO(&rfds);
+            FD_SET(sock, &rfds);
+            int r = select(sock+1, &rfds, NULL, NULL, &tv);
+            if (r<0)
+                dlerror("error: failed to select on network socket");
+            if (r==0)
+                timed_out = 1;
         }
 
-        bytesleft += read;
+        /* wait for the first datagram then take whatever else fits up to the end of the ring */
+        unsigned index = head & (depth-1);
+        unsigned count = mmin(depth-(head-tail), depth-index);
+        if (!timed_out && count)
+            head += receive(index, count, MSG_WAITFORONE);
     }
 
-    /* copy to caller buffer */
-    size_t read = mmin(bytes, bytesleft);
-    memcpy(buf, bufptr, read);
-    bufptr += read;
-    bytesleft -= read;
+    if (timed_out) {
+        dlmessage("timeout on network socket read");
+        return -1;
+    }
+    return 0;
+}
+
+/* hand the slot being read back to the receiver */
+void dlsock::release()
+{
+    __atomic_store_n(&tail, tail+1, __ATOMIC_RELEASE);
+    offset = 0;
+}
+
+/* copy from the slots, optionally waiting for more datagrams until the buffer is full */
+size_t dlsock::gather(unsigned char *buf, size_t bytes, bool wait)
+{
+    size_t read = 0;
+    while (read<bytes) {
+        if (tail==__atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+            /* return what has arrived rather than wait */
+            if (read && !wait)
+                break;
+            if (refill(tail)<0)
+                return read? read : -1;
+            continue;
+        }
+
+        unsigned index = tail & (depth-1);
+        size_t n = mmin(bytes-read, msgs[index].msg_len-offset);
+        arrived = arrivals[index];
+        memcpy(buf+read, slots+index*SOCK_SLOTSIZE+offset, n);
+        read += n;
+        offset += n;
+        if (offset==msgs[index].msg_len)
+            release();
+    }
 
     return read;
 }
 
+size_t dlsock::read(unsigned char *buf, size_t bytes, dltoken_t t)
+{
+    return gather(buf, bytes, false);
+}
+
+/* zero copy read from a datagram slot, unless the read spans datagrams */
 const unsigned char *dlsock::read(size_t *bytes, dltoken_t t)
 {
-    /* check internal buffer is large enough */
-    checksize(*bytes);
+    /* release the slot of the previous read once it is all read, waiting for a datagram if the ring is empty */
+    while (1) {
+        if (tail==__atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+            if (refill(tail)<0) {
+                *bytes = 0;
+                return buffer;
+            }
+        } else if (offset==msgs[tail & (depth-1)].msg_len)
+            release();
+        else
+            break;
+    }
 
-    size_t read = dlsock::read(buffer, *bytes);
-    if (read!=*bytes)
-        *bytes = read;
+    unsigned index = tail & (depth-1);
+    size_t left = msgs[index].msg_len - offset;
+    if (*bytes==0)
+        *bytes = left;
+    if (*bytes<=left) {
+        const unsigned char *ret = slots + index*SOCK_SLOTSIZE + offset;
+        arrived = arrivals[index];
+        offset += *bytes;
+        return ret;
+    }
+
+    /* gather the datagrams into the internal buffer */
+    checksize(*bytes);
+    size_t read = gather(buffer, *bytes, true);
+    *bytes = read==(size_t)-1? 0 : read;
 
     return buffer;
 }
@@ -512,6 +1359,471 @@ bool dlsock::eof(dltoken_t token)
     return sock>=0? 0 : 1;
 }
 
+unsigned long long dlsock::dropped()
+{
+    return __atomic_load_n(&drops, __ATOMIC_RELAXED);
+}
+
+ringstats_t dlsock::ringstats()
+{
+    ringstats_t stats = {0, 0, 0, 0, 0};
+    if (threaded && msgs) {
+        stats.depth = depth;
+        stats.fill = __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        stats.watermark = __atomic_load_n(&watermark, __ATOMIC_RELAXED);
+        stats.overflows = __atomic_load_n(&overflows, __ATOMIC_RELAXED);
+    }
+    stats.truncated = __atomic_load_n(&truncated, __ATOMIC_RELAXED);
+    return stats;
+}
+
+/* rtp network socket source class */
+dlrtp::dlrtp()
+{
+    fec[0] = fec[1] = NULL;
+    latency = 0;
+}
+
+dlrtp::dlrtp(const char *a) : dlsock(a)
+{
+    fec[0] = fec[1] = NULL;
+    latency = 0;
+}
+
+dlrtp::dlrtp(const char *a, const char *i) : dlsock(a, i)
+{
+    fec[0] = fec[1] = NULL;
+    latency = 0;
+}
+
+dlrtp::~dlrtp()
+{
+    delete fec[0];
+    delete fec[1];
+}
+
+void dlrtp::set_fec(unsigned l)
+{
+    latency = l;
+}
+
+int dlrtp::open(const char *port)
+{
+    dlsock::open(port);
+
+    done.assign(depth, 0);
+    current = -1;
+    packet = NULL;
+    end = 0;
+    started = false;
+    window = RTP_WINDOW;
+    num_lost = num_late = num_recovered = 0;
+
+    if (latency) {
+        /* the reader must not wait for more packets than the ring can hold */
+        window = latency;
+        if (window>depth/2) {
+            window = depth/2;
+            dlmessage("warning: limiting fec latency to %u packets, half the depth of the receive ring", window);
+        }
+
+        /* the column fec stream is on the port two above the media and the row fec stream four above */
+        for (int k=0; k<2; k++) {
+            char fecport[16];
+            snprintf(fecport, sizeof(fecport), "%d", atoi(port)+2*(k+1));
+            fec[k] = new dlrtp(multicast, interface);
+            fec[k]->open(fecport);
+        }
+
+        /* hold enough packets to recover from a window of arrivals plus a matrix before it */
+        unsigned size;
+        for (size=256; size<2*window; size*=2);
+        fecs.resize(size);
+        held.resize(size);
+        for (unsigned i=0; i<size; i++) {
+            fecs[i].na = 0;
+            held[i].valid = false;
+        }
+        fecnext = 0;
+        fec_received = fec_tried = 0;
+    }
+
+    return 0;
+}
+
+filetype_t dlrtp::autodetect()
+{
+    /* a timeout is not useful information here */
+    set_timeout(0);
+
+    /* look at the payload of the first packet without reading it */
+    if (packet==NULL || offset==end)
+        next();
+    if (end-offset>=188 && packet[offset]==0x47)
+        return TS;
+
+    return OTHER;
+}
+
+/* find the payload of an rtp packet, returns -1 if it is not one */
+int dlrtp::payload(unsigned slot, unsigned short *seq, size_t *start, size_t *end)
+{
+    const unsigned char *p = slots + slot*SOCK_SLOTSIZE;
+    size_t len = msgs[slot].msg_len;
+    if (len<12 || (p[0]>>6)!=2)
+        return -1;
+
+    /* skip the fixed header, contributing sources and header extension */
+    size_t ptr = 12 + 4*(p[0] & 0xf);
+    if (p[0] & 0x10) {
+        if (ptr+4>len)
+            return -1;
+        ptr += 4 + 4*((p[ptr+2]<<8) | p[ptr+3]);
+    }
+
+    /* remove padding */
+    if (p[0] & 0x20) {
+        if (len==0 || p[len-1]>len)
+            return -1;
+        len -= p[len-1];
+    }
+    if (ptr>len)
+        return -1;
+
+    *seq = (p[2]<<8) | p[3];
+    *start = ptr;
+    *end = len;
+    return 0;
+}
+
+/* mark a slot as read, and hand back the read slots at the tail of the ring to the receiver */
+void dlrtp::consume(unsigned slot)
+{
+    done[slot] = 1;
+
+    unsigned h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    unsigned t = tail;
+    while (t!=h && done[t & (depth-1)]) {
+        done[t & (depth-1)] = 0;
+        t++;
+    }
+    __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+}
+
+/* receive the waiting fec packets without blocking, returns the number received */
+int dlrtp::drain()
+{
+    int received = 0;
+    for (int k=0; k<2; k++) {
+        int n;
+        while ((n = fec[k]->receive(0, SOCK_SLOTS, MSG_DONTWAIT))>0) {
+            for (int i=0; i<n; i++) {
+                unsigned short seq;
+                size_t start, stop;
+                if (fec[k]->payload(i, &seq, &start, &stop)<0 || stop-start<16)
+                    continue;
+
+                /* parse the fec header, only the xor of 2022-1 is supported */
+                const unsigned char *h = fec[k]->slots + i*SOCK_SLOTSIZE + start;
+                if (h[13]==0 || h[14]==0 || (h[12]>>3 & 0x7)!=0)
+                    continue;
+                fecpacket_t *f = &fecs[fecnext++ & (fecs.size()-1)];
+                f->snbase = (h[0]<<8) | h[1];
+                f->length = (h[2]<<8) | h[3];
+                f->offset = h[13];
+                f->na = h[14];
+                f->bytes = stop - start - 16;
+                memcpy(f->data, h+16, f->bytes);
+                received++;
+            }
+        }
+    }
+
+    fec_received += received;
+    return received;
+}
+
+/* keep a copy of the payload of a media packet for later recoveries */
+void dlrtp::hold(unsigned short seq, const unsigned char *data, size_t bytes)
+{
+    heldpacket_t *m = &held[seq & (held.size()-1)];
+    m->seq = seq;
+    m->valid = true;
+    m->bytes = bytes;
+    memcpy(m->data, data, bytes);
+}
+
+/* find the payload of a media packet, either already read or waiting in the ring */
+const unsigned char *dlrtp::media(unsigned short seq, size_t *bytes)
+{
+    heldpacket_t *m = &held[seq & (held.size()-1)];
+    if (m->valid && m->seq==seq) {
+        *bytes = m->bytes;
+        return m->data;
+    }
+
+    unsigned h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    for (unsigned i=tail; i!=h; i++) {
+        unsigned slot = i & (depth-1);
+        unsigned short s;
+        size_t start, stop;
+        if (payload(slot, &s, &start, &stop)==0 && s==seq) {
+            *bytes = stop - start;
+            return slots + slot*SOCK_SLOTSIZE + start;
+        }
+    }
+
+    return NULL;
+}
+
+/* rebuild a missing media packet from a fec packet and the other media packets it protects */
+bool dlrtp::recover(unsigned short seq)
+{
+    const kernels_t *kernels = get_kernels();
+    heldpacket_t *m = &held[seq & (held.size()-1)];
+
+    for (unsigned i=0; i<fecs.size(); i++) {
+        fecpacket_t *f = &fecs[i];
+        unsigned short d = seq - f->snbase;
+        if (f->na==0 || d%f->offset || d/f->offset>=f->na)
+            continue;
+
+        /* xor the fec payload with the payloads of the other media packets */
+        m->valid = false;
+        memcpy(m->data, f->data, f->bytes);
+        size_t length = f->length;
+        int j;
+        for (j=0; j<f->na; j++) {
+            unsigned short s = f->snbase + j*f->offset;
+            if (s==seq)
+                continue;
+            size_t bytes;
+            const unsigned char *p = media(s, &bytes);
+            if (p==NULL || bytes>f->bytes)
+                break;
+            kernels->xor_block(m->data, p, bytes);
+            length ^= bytes;
+        }
+        if (j<f->na || length>f->bytes)
+            continue;
+
+        m->seq = seq;
+        m->valid = true;
+        m->bytes = length;
+        num_recovered++;
+        return true;
+    }
+
+    return false;
+}
+
+/* move to the packet with the next sequence number, waiting for it until the window is full
+ * or the read times out, returns false if there is no packet to read */
+bool dlrtp::next()
+{
+    /* finished with the packet being read */
+    if (current>=0) {
+        consume(current);
+        current = -1;
+    }
+    packet = NULL;
+
+    /* the read has timed out, stop waiting for missing packets */
+    bool stalled = false;
+
+    while (1) {
+        /* look for the next sequence number among the unread packets, in order of arrival */
+        unsigned h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        unsigned unread = 0;
+        int found = -1, oldest = -1;
+        unsigned short gap = 0;
+        unsigned first = h, passed = 0;
+        for (unsigned i=tail; i!=h && unread<window; i++) {
+            /* skip slots handed back since the scan started */
+            if ((int)(tail-i)>0)
+                i = tail;
+            if (i==h)
+                break;
+            unsigned slot = i & (depth-1);
+            if (done[slot]) {
+                if (first!=h)
+                    passed++;
+                continue;
+            }
+
+            unsigned short seq;
+            size_t start, stop;
+            if (payload(slot, &seq, &start, &stop)<0) {
+                /* not an rtp packet */
+                consume(slot);
+                continue;
+            }
+            if (!started) {
+                expected = seq;
+                started = true;
+            }
+
+            short diff = (short)(seq - expected);
+            if (diff<-RTP_MAX_DROPOUT || diff>RTP_MAX_DROPOUT) {
+                /* the stream has restarted */
+                expected = seq;
+                diff = 0;
+            }
+            if (diff<0) {
+                /* duplicate or too late, the packet has already been given up on */
+                num_late++;
+                consume(slot);
+                continue;
+            }
+            if (diff==0) {
+                found = slot;
+                break;
+            }
+
+            /* out of order, wait for the packets before it */
+            if (oldest<0 || diff<gap) {
+                oldest = slot;
+                gap = diff;
+            }
+            if (unread==0)
+                first = i;
+            unread++;
+        }
+
+        /* a packet still waiting after a window of later arrivals have been read does not belong
+         * to the stream, give up on it before it holds the tail of the ring until the ring fills */
+        if (passed>window) {
+            num_late++;
+            consume(first & (depth-1));
+            continue;
+        }
+
+        if (fec[0] && found<0 && oldest>=0) {
+            /* the next packet is missing, try to rebuild it when fec packets arrive or before giving up on it */
+            drain();
+            bool giveup = unread>=window || stalled;
+            if (fec_received!=fec_tried || giveup) {
+                fec_tried = fec_received;
+                if (recover(expected)) {
+                    heldpacket_t *m = &held[expected & (held.size()-1)];
+                    packet = m->data;
+                    offset = 0;
+                    end = m->bytes;
+                    expected++;
+                    return true;
+                }
+            }
+
+            /* give up on the missing packet, the next may be recoverable */
+            if (giveup) {
+                num_lost++;
+                expected++;
+                continue;
+            }
+        }
+
+        /* give up on the missing packets when the window is full */
+        if (found<0 && unread>=window) {
+            num_lost += gap;
+            expected += gap;
+            found = oldest;
+        }
+
+        if (found<0) {
+            if (refill(h)==0)
+                continue;
+
+            /* give up on the missing packets on timeout */
+            if (oldest<0)
+                return false;
+            if (fec[0]) {
+                stalled = true;
+                continue;
+            }
+            num_lost += gap;
+            expected += gap;
+            found = oldest;
+        }
+
+        /* read the payload of the packet */
+        unsigned short seq;
+        size_t start;
+        payload(found, &seq, &start, &end);
+        current = found;
+        packet = slots + found*SOCK_SLOTSIZE;
+        arrived = arrivals[found];
+        offset = start;
+        expected++;
+
+        /* keep a copy for recovering later packets, and collect fec packets before the kernel runs out of buffer */
+        if (fec[0]) {
+            hold(seq, packet+start, end-start);
+            if ((seq & 15)==0)
+                drain();
+        }
+        return true;
+    }
+}
+
+/* read with copy of the payload of packets in order */
+size_t dlrtp::read(unsigned char *buf, size_t bytes, dltoken_t t)
+{
+    size_t read = 0;
+    while (read<bytes) {
+        if (packet==NULL || offset==end)
+            if (!next())
+                return read? read : -1;
+
+        size_t n = mmin(bytes-read, end-offset);
+        memcpy(buf+read, packet+offset, n);
+        read += n;
+        offset += n;
+    }
+
+    return read;
+}
+
+/* zero copy read of the payload of a packet, unless the read spans packets */
+const unsigned char *dlrtp::read(size_t *bytes, dltoken_t t)
+{
+    if (packet==NULL || offset==end)
+        if (!next()) {
+            *bytes = 0;
+            return buffer;
+        }
+
+    size_t left = end - offset;
+    if (*bytes==0)
+        *bytes = left;
+    if (*bytes<=left) {
+        const unsigned char *ret = packet + offset;
+        offset += *bytes;
+        return ret;
+    }
+
+    /* gather the packets into the internal buffer */
+    checksize(*bytes);
+    size_t read = dlrtp::read(buffer, *bytes, t);
+    *bytes = read==(size_t)-1? 0 : read;
+
+    return buffer;
+}
+
+unsigned long long dlrtp::lost()
+{
+    return num_lost;
+}
+
+unsigned long long dlrtp::late()
+{
+    return num_late;
+}
+
+unsigned long long dlrtp::recovered()
+{
+    return num_recovered;
+}
+
 /* network tcp socket source class */
 dltcpsock::dltcpsock()
 {
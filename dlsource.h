@@ -2,6 +2,7 @@
 #define DLSOURCE_H
 
 #include <stdio.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -14,6 +15,21 @@
 /* type of token returned when attaching format decoders */
 typedef int dltoken_t;
 
+/* statistics of a receive ring, the depth is zero without one */
+typedef struct {
+    unsigned depth;
+    unsigned fill;              /* slots waiting to be read */
+    unsigned watermark;         /* highest fill */
+    unsigned long long overflows;   /* datagrams discarded because the ring was full */
+    unsigned long long truncated;   /* datagrams larger than a slot, with or without a ring */
+} ringstats_t;
+
+/* a piece of a scatter-gather read */
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+} span_t;
+
 /* virtual base class for data sources */
 class dlsource
 {
@@ -40,9 +56,22 @@ public:
     virtual bool eof(dltoken_t token=0);
     virtual bool error(dltoken_t token=0);
     virtual bool timeout();
+    /* zero copy reads stay valid until the source is closed, not just until the next read */
+    virtual bool retains() { return false; }
+    virtual unsigned long long dropped() { return 0; }
+    virtual ringstats_t ringstats() { ringstats_t stats = {0, 0, 0, 0, 0}; return stats; }
+    /* packets of a sequenced stream which were lost, or arrived too late to be reordered */
+    virtual unsigned long long lost() { return 0; }
+    virtual unsigned long long late() { return 0; }
+    /* lost packets which were rebuilt by forward error correction */
+    virtual unsigned long long recovered() { return 0; }
+    /* time of arrival in usecs of the data last read, zero if unknown */
+    virtual unsigned long long arrival() { return 0; }
 
     /* source configuration */
     virtual void set_timeout(int timeout_usec);
+    /* size of the records read, a hint for sources which read ahead */
+    virtual void set_readsize(size_t bytes) {}
 
 protected:
     /* memory buffer management */
@@ -87,7 +116,11 @@ protected:
     std::vector<int> eof_flag, error_flag;
 };
 
-/* memory mapped file souce class */
+/* size of the kernel read-ahead window of memory mapped readers */
+#define MMAP_WINDOW (8*1024*1024)
+
+/* memory mapped file souce class, each reader has its own cursor into the mapping,
+ * pages ahead of each reader are prefetched and pages behind the slowest are released */
 class dlmmap : public dlfile
 {
 public:
@@ -97,22 +130,137 @@ public:
     /* source operators */
     virtual int open(const char *filename);
     virtual int rewind(dltoken_t token=0);
+    virtual dltoken_t attach();
     virtual size_t read(unsigned char *buf, size_t bytes, dltoken_t token=0);
     virtual const unsigned char *read(size_t *bytes, dltoken_t token=0);
 
     /* source metadata */
+    virtual const char *description() { return "mmap"; }
     virtual size_t size();
+    virtual bool retains() { return true; }
     virtual off_t pos(dltoken_t token);
     virtual bool eof(dltoken_t token);
     virtual bool error(dltoken_t token);
 
 protected:
+    void advise(dltoken_t t);
+
     /* memory map variables */
-    unsigned char *addr, *ptr;
+    unsigned char *addr;
     size_t length;
+
+    /* reader variables, a reader only holds back the window once it has read since a rewind */
+    std::vector<size_t> cursor;
+    std::vector<size_t> ahead;      /* end of the prefetched window */
+    std::vector<char> active;
+    size_t released;                /* start of pages not yet released */
 };
 
-/* network socket source class */
+/* maximum depth of read-ahead of each reader */
+#define MAX_READAHEAD 8
+
+/* asynchronous read-ahead file source class, each reader has a window of large
+ * aligned reads in flight using io_uring, or synchronous reads if unavailable */
+class dluring : public dlfile
+{
+public:
+    dluring(int depth=3, size_t chunksize=2*1024*1024);
+    ~dluring();
+
+    /* source operators */
+    virtual int open(const char *filename);
+    virtual int rewind(dltoken_t token=0);
+    virtual dltoken_t attach();
+    virtual size_t read(unsigned char *buf, size_t bytes, dltoken_t token=0);
+    virtual const unsigned char *read(size_t *bytes, dltoken_t token=0);
+
+    /* source metadata */
+    virtual const char *description() { return ring? "io_uring" : "read-ahead"; }
+    virtual off_t pos(dltoken_t token);
+
+    /* source configuration */
+    virtual void set_readsize(size_t bytes);
+
+protected:
+    /* a read of the window */
+    typedef struct {
+        unsigned char *data;
+        off_t offset;       /* file offset of the data */
+        size_t length;      /* bytes read, zero at end of file */
+        int state;
+        bool retried;       /* the read has been retried without direct i/o */
+    } chunk_t;
+
+    /* read-ahead window of a reader */
+    typedef struct {
+        chunk_t chunk[MAX_READAHEAD];
+        int current;        /* chunk being consumed */
+        size_t used;        /* bytes consumed from the current chunk */
+        off_t next;         /* file offset of the next read to submit */
+        off_t position;     /* file offset of the reader */
+        bool consumed;      /* current chunk can be resubmitted on the next read */
+    } window_t;
+
+    /* file descriptor and offset in that file of a read */
+    virtual int locate(dltoken_t t, off_t offset, off_t *physical);
+    /* a read was refused by direct i/o, returns true if it can be retried through the page cache */
+    virtual bool fall_back() { return false; }
+
+    void start();
+    void setup(dltoken_t t);
+    void submit(dltoken_t t, int c);
+    void advance(dltoken_t t);
+    void complete(bool wait);
+    chunk_t *ready(dltoken_t t);
+
+    /* read-ahead parameters */
+    int depth;
+    size_t chunksize;
+    size_t align;           /* alignment of reads, an unaligned short read is the end of file */
+    std::vector<window_t *> window;
+
+    /* submission and completion queues, null if io_uring is unavailable */
+    struct ring_t *ring;
+};
+
+/* direct i/o file source class, reads bypass the page cache, optionally striped by
+ * frame across several files or devices, given as a comma separated list, reads are aligned
+ * to the largest logical block size of the devices, so striped frames must be a whole
+ * number of blocks */
+class dldirect : public dluring
+{
+public:
+    dldirect(int depth=4);
+    ~dldirect();
+
+    /* source operators */
+    virtual int open(const char *filenames);
+    virtual dltoken_t attach();
+
+    /* source metadata */
+    virtual const char *description() { return ring? "direct io_uring" : "direct"; }
+    virtual size_t size();
+
+    /* source configuration */
+    virtual void set_readsize(size_t bytes);
+
+protected:
+    virtual int locate(dltoken_t t, off_t offset, off_t *physical);
+    virtual bool fall_back();
+    void open_stripes();
+
+    /* files of the stripes, the descriptors of reader t are file[t*stripes.size()+i] */
+    std::vector<char *> stripes;
+    bool direct;
+};
+
+/* number and size of the datagram slots of a batched socket receive */
+#define SOCK_SLOTS 64
+#define SOCK_SLOTSIZE 2048
+#define SOCK_CONTROLSIZE 64
+
+/* network socket source class, datagrams are received in batches into a ring of slots,
+ * either by the reader when the ring is empty or continuously by a receive thread */
 class dlsock : public dlsource
 {
 public:
@@ -132,12 +280,149 @@ public:
     /* source metadata */
     virtual const char *description() { return "udp"; }
     virtual bool eof(dltoken_t token);
+    virtual unsigned long long dropped();
+    virtual ringstats_t ringstats();
+    virtual unsigned long long arrival() { return arrived; }
+
+    /* source configuration, before opening */
+    /* receive into a ring of at least this many datagrams from a thread, zero to receive when reading */
+    void set_ring(unsigned depth);
 
 protected:
+    static void *receive_thread(void *arg);
+    void run_receive();
+    int receive(unsigned first, unsigned count, int flags);
+    int refill(unsigned seen);
+    void release();
+    size_t gather(unsigned char *buf, size_t bytes, bool wait);
+
     int sock;
     socklen_t addr_len;
     struct sockaddr_in name, sender;
     const char *multicast, *interface;
+
+    /* ring of datagram slots, a power of two in size, the indices are free running */
+    unsigned depth;
+    unsigned char *slots;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    unsigned char *control;
+    unsigned long long *arrivals;   /* receive time of each slot in usecs */
+    unsigned head __attribute__((aligned(64)));     /* slots filled, written by the receiver */
+    unsigned tail __attribute__((aligned(64)));     /* slots read, written by the reader */
+    size_t offset;              /* bytes read from the slot being read */
+    unsigned long long arrived; /* receive time of the datagram last read */
+
+    /* receive thread, the reader waits on the condition when the ring is empty */
+    bool threaded;
+    pthread_t thread;
+    bool running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned waiting;
+
+    /* ring statistics, datagrams truncated to a slot, and datagrams dropped by the kernel for lack of receive buffer space */
+    unsigned watermark;
+    unsigned long long overflows;
+    unsigned long long truncated;
+    unsigned long long drops;
+};
+
+/* size of the reordering window of rtp packets, and the largest jump in sequence
+ * number which is treated as loss rather than a restart of the stream, as in rfc 3550 */
+#define RTP_WINDOW 32
+#define RTP_MAX_DROPOUT 3000
+
+/* default number of packets to wait for a missing packet to be recovered by forward error
+ * correction, smpte 2022-1 allows matrices of up to 100 packets and the column fec packets
+ * of a matrix are sent interleaved with the next one */
+#define RTP_FEC_WINDOW 256
+
+/* rtp network socket source class, packets are reordered by sequence number within
+ * a window and their payload is read in place from the datagram slots, missing packets
+ * are optionally rebuilt from smpte 2022-1 column and row fec streams */
+class dlrtp : public dlsock
+{
+public:
+    dlrtp();
+    dlrtp(const char *address);                         /* multicast */
+    dlrtp(const char *address, const char *interface);  /* multi-homed multicast */
+    ~dlrtp();
+
+    /* source operators */
+    virtual int open(const char *port);
+    virtual filetype_t autodetect();
+    virtual size_t read(unsigned char *buf, size_t bytes, dltoken_t token=0);
+    virtual const unsigned char *read(size_t *bytes, dltoken_t token=0);
+
+    /* source metadata */
+    virtual const char *description() { return fec[0]? "rtp fec" : "rtp"; }
+    virtual unsigned long long lost();
+    virtual unsigned long long late();
+    virtual unsigned long long recovered();
+
+    /* source configuration, before opening */
+    /* receive the column and row fec streams on the ports two and four above the media,
+     * and wait up to this many packets for a missing packet to be recovered, zero for no fec */
+    void set_fec(unsigned latency);
+
+protected:
+    bool next();
+    int payload(unsigned slot, unsigned short *seq, size_t *start, size_t *end);
+    void consume(unsigned slot);
+
+    /* forward error correction */
+    int drain();
+    void hold(unsigned short seq, const unsigned char *data, size_t bytes);
+    const unsigned char *media(unsigned short seq, size_t *bytes);
+    bool recover(unsigned short seq);
+
+    /* slots read out of order, released when they reach the tail of the ring */
+    std::vector<char> done;
+
+    /* packet being read, either in a slot or rebuilt, the payload is read from offset up to end */
+    int current;
+    const unsigned char *packet;
+    size_t end;
+
+    /* next sequence number to read, and the number of packets received after a missing one before it is given up on */
+    bool started;
+    unsigned short expected;
+    unsigned window;
+
+    /* a fec packet, the xor of the media packets snbase+j*offset for j<na */
+    typedef struct {
+        unsigned short snbase;
+        unsigned char offset;
+        unsigned char na;
+        unsigned short length;      /* xor of the payload lengths */
+        size_t bytes;
+        unsigned char data[SOCK_SLOTSIZE];
+    } fecpacket_t;
+
+    /* a copy of the payload of a media packet already read, or rebuilt */
+    typedef struct {
+        unsigned short seq;
+        bool valid;
+        size_t bytes;
+        unsigned char data[SOCK_SLOTSIZE];
+    } heldpacket_t;
+
+    /* column and row fec sockets, null without fec */
+    dlrtp *fec[2];
+    unsigned latency;
+
+    /* recent fec packets in order of arrival, and recent media packets indexed by sequence number,
+     * both a power of two in size */
+    std::vector<fecpacket_t> fecs;
+    unsigned fecnext;
+    unsigned long long fec_received, fec_tried;
+    std::vector<heldpacket_t> held;
+
+    /* loss statistics */
+    unsigned long long num_lost;
+    unsigned long long num_late;
+    unsigned long long num_recovered;
 };
 
 /* network tcp socket source class */
@@ -5,9 +5,11 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "dlutil.h"
+#include "dlkernel.h"
 #include "dlts.h"
 
 /* peek at the next character in the file */
@@ -30,35 +32,154 @@ int ffind(int f, FILE *file)
     return 0;
 }
 
-/* read next data packet from transport stream */
-int next_packet(unsigned char *packet, dlsource *source, dltoken_t token)
+/* find the packets of a block and describe their headers, a lost sync is found again with
+ * a lookahead of several packets, returns the number of packets described, the bytes
+ * consumed stop short of a packet which continues beyond the end of the block */
+int parse_packets(const unsigned char *block, size_t bytes, tspacket_t *packets, int max_packets, size_t *consumed)
+{
+    static const kernels_t *kernels = get_kernels();
+
+    size_t i = 0;
+    int n = 0;
+    while (n<max_packets && i<bytes) {
+        if (block[i]!=0x47) {
+            /* resync on the next run of packets */
+            int sync = kernels->find_sync(block+i, bytes-i);
+            if (sync<0) {
+                i = bytes;
+                break;
+            }
+            i += sync;
+        }
+        if (i+188>bytes)
+            break;
+
+        const unsigned char *p = block + i;
+        tspacket_t *d = &packets[n++];
+        d->offset = i;
+        d->pid = ((p[1]<<8) | p[2]) & 0x1fff;
+        d->cc = p[3] & 0xf;
+
+        /* the payload follows the adaptation field, if any */
+        int adaptation_field_control = (p[3] >> 4) & 0x3;
+        unsigned payload = 4;
+        d->flags = (p[1] & 0x80? TS_FLAG_ERROR : 0) | (p[1] & 0x40? TS_FLAG_PUSI : 0);
+        if (adaptation_field_control & 2) {
+            d->flags |= TS_FLAG_ADAPTATION;
+            payload += 1 + p[4];
+        }
+        if ((adaptation_field_control & 1) && payload<188)
+            d->flags |= TS_FLAG_PAYLOAD;
+        else
+            payload = 188;
+        d->payload = payload;
+
+        i += 188;
+    }
+
+    *consumed = i;
+    return n;
+}
+
+/* the program clock reference of a packet in 27MHz units, or -1 if it has none */
+long long packet_pcr(const unsigned char *p, const tspacket_t *d)
+{
+    /* pcr_flag of an adaptation field long enough to carry it */
+    if (!(d->flags & TS_FLAG_ADAPTATION) || (d->flags & TS_FLAG_ERROR) || p[4]<7 || !(p[5] & 0x10))
+        return -1;
+
+    long long program_clock_reference_base = (long long)p[6]<<25 | p[7]<<17 | p[8]<<9 | p[9]<<1 | p[10]>>7;
+    int program_clock_reference_extension = (p[10] & 1)<<8 | p[11];
+    return program_clock_reference_base*300 + program_clock_reference_extension;
+}
+
+/* crc_32 of psi sections, the msb first crc with the generator polynomial 0x04c11db7 and no
+ * final inversion, computed slice-by-8 with a table for each byte of an eight byte load */
+static uint32_t crc_table[8][256];
+
+static void make_crc_table()
+{
+    for (int i=0; i<256; i++) {
+        uint32_t crc = i << 24;
+        for (int b=0; b<8; b++)
+            crc = crc & 0x80000000? (crc<<1) ^ 0x04c11db7 : crc<<1;
+        crc_table[0][i] = crc;
+    }
+    for (int k=1; k<8; k++)
+        for (int i=0; i<256; i++)
+            crc_table[k][i] = (crc_table[k-1][i] << 8) ^ crc_table[0][crc_table[k-1][i] >> 24];
+}
+
+uint32_t crc32_mpeg2(const unsigned char *data, size_t bytes)
 {
+    static bool init = (make_crc_table(), true);
+    (void)init;
+
+    uint32_t crc = 0xffffffff;
+    while (bytes>=8) {
+        crc ^= (uint32_t)data[0]<<24 | data[1]<<16 | data[2]<<8 | data[3];
+        crc = crc_table[7][crc>>24] ^ crc_table[6][(crc>>16) & 0xff] ^ crc_table[5][(crc>>8) & 0xff] ^ crc_table[4][crc & 0xff]
+            ^ crc_table[3][data[4]] ^ crc_table[2][data[5]] ^ crc_table[1][data[6]] ^ crc_table[0][data[7]];
+        data += 8;
+        bytes -= 8;
+    }
+    while (bytes--)
+        crc = (crc<<8) ^ crc_table[0][(crc>>24) ^ *data++];
+
+    return crc;
+}
+
+/* read next data packet from transport stream without a copy where the source allows,
+ * the packet is in the source or the scratch buffer and is valid until the next read */
+const unsigned char *next_packet_ptr(unsigned char *scratch, dlsource *source, dltoken_t token)
+{
+    /* zero copy read of a whole packet */
+    size_t bytes = 188;
+    const unsigned char *data = source->read(&bytes, token);
+    if (data && bytes==188 && data[0]==0x47)
+        return data;
+
+    /* short read or lost sync, complete the packet in the scratch buffer */
+    int read = data? bytes : 0;
+    if (read)
+        memcpy(scratch, data, read);
     while (1) {
         /* read a packet sized chunk */
-        int read = 0;
         while (read!=188) {
-            int ret = source->read(packet, 188-read, token);
+            int ret = source->read(scratch+read, 188-read, token);
             if (ret<=0) {
                 dlmessage("failed to read %d bytes of a transport stream packet", 188-read);
-                return -1;
+                return NULL;
             }
             read += ret;
         }
 
-        if (packet[0]==0x47 /*&& fpeek(file)==0x47*/) // TODO lookahead in dlsource.
+        if (scratch[0]==0x47)
             /* success */
-            return 0;
-
-        /* resync or try again */
-        for (int i=1; i<188; i++) {
-            if (packet[i]==0x47) {
-                memmove(packet, packet+i, 188-i);
-                source->read(packet+188-i, i, token);
-            }
-        }
+            return scratch;
+
+        /* resync on the next sync byte and try again */
+        int i;
+        for (i=1; i<188; i++)
+            if (scratch[i]==0x47)
+                break;
+        memmove(scratch, scratch+i, 188-i);
+        read = 188-i;
     }
 }
 
+/* read next data packet from transport stream into a buffer */
+int next_packet(unsigned char *packet, dlsource *source, dltoken_t token)
+{
+    const unsigned char *data = next_packet_ptr(packet, source, token);
+    if (data==NULL)
+        return -1;
+    if (data!=packet)
+        memcpy(packet, data, 188);
+
+    return 0;
+}
+
 /* read next packet from transport stream with specified pid
  * return packet length or error code on failure */
 int next_data_packet(unsigned char *data, int pid, dlsource *source, dltoken_t token)
@@ -202,89 +323,687 @@ int next_pes_packet_data(unsigned char *data, long long *pts, long long *dts, in
     return 0;
 }
 
-int find_pid_for_stream_type(int stream_types[], int num_stream_types, int *found_type, dlsource *source, dltoken_t token)
+/* read the program association table and the program map of each program,
+ * return the number of elementary streams found or zero on failure */
+int find_program_streams(int stream_types[], int pids[], int max_streams, dlsource *source, dltoken_t token)
 {
-    unsigned char packet[188];
+    unsigned char scratch[188];
+    dlpsi psi;
+
+    /* read packets until the pat and all of its pmts have been reassembled */
+    while (!psi.complete()) {
+        const unsigned char *packet = next_packet_ptr(scratch, source, token);
+        if (packet==NULL) {
+            if (!psi.has_pat()) {
+                dlmessage("failed to find a pat in input file \"%s\" (need to specify the pids)", source->name());
+                return 0;
+            }
+            dlmessage("failed to find a pmt in input file \"%s\" (need to specify the pids)", source->name());
+            break;
+        }
+
+        tspacket_t desc;
+        size_t consumed;
+        if (parse_packets(packet, 188, &desc, 1, &consumed))
+            psi.add(packet, &desc);
+    }
+
+    return psi.streams(stream_types, pids, max_streams);
+}
+
+/* find the first elementary stream of a program which carries one of the given stream types */
+int find_pid_in_program(int stream_types[], int num_stream_types, int *found_type, const int program_types[], const int program_pids[], int num_streams)
+{
+    for (int s=0; s<num_streams; s++)
+        /* try to match stream type */
+        for (int i=0; i<num_stream_types; i++)
+            if (stream_types[i]==program_types[s]) {
+                *found_type = program_types[s];
+                return program_pids[s];
+            }
+    /* stream_type==0x02 - mpeg2 video
+     * stream_type==0x80 - user private, assume mpeg2 video
+     * stream_type==0x03 - mpeg1 audio
+     * stream_type==0x04 - mpeg2 audio
+     * stream_type==0x81 - user private, assume ac3 audio
+     * stream_type==0x1b - h.264 video
+     * stream_type==0x24 - hevc video */
+
+    return 0;
+}
 
+int find_pid_for_stream_type(int stream_types[], int num_stream_types, int *found_type, dlsource *source, dltoken_t token)
+{
     /* sanity check */
     if (stream_types==NULL)
         return 0;
     if (num_stream_types==0)
         return 0;
 
-    /* find the pmt pid */
-    int pmt_pid[16] = {0};
-    int num_pmts = 0;
-    do {
+    int program_types[TS_MAX_STREAMS], program_pids[TS_MAX_STREAMS];
+    int num_streams = find_program_streams(program_types, program_pids, TS_MAX_STREAMS, source, token);
+    return find_pid_in_program(stream_types, num_stream_types, found_type, program_types, program_pids, num_streams);
+}
 
-        /* find the next pat */
-        int read = next_data_packet(packet, 0, source, token);
-        if (read<=0) {
-            dlmessage("failed to find a pat in input file \"%s\" (need to specify the pids)", source->name());
-            return 0;
+/* section assembler */
+dlsection::dlsection()
+{
+    crc_errors = 0;
+    fill = -1;
+    last_cc = -1;
+    taken = 0;
+}
+
+/* add bytes to the section being assembled, returns the number of bytes used */
+int dlsection::gather(const unsigned char *data, int bytes)
+{
+    int used = 0;
+
+    /* the section header up to section_length */
+    if (fill<3) {
+        int n = mmin(3-fill, bytes);
+        memcpy(section+fill, data, n);
+        fill += n;
+        used += n;
+        if (fill<3)
+            return used;
+    }
+    int length = 3 + ((section[1]<<8 | section[2]) & 0xfff);
+    if (length>TS_MAX_SECTION) {
+        fill = -1;
+        return bytes;
+    }
+
+    /* the body of the section */
+    int n = mmin(length-fill, bytes-used);
+    memcpy(section+fill, data+used, n);
+    fill += n;
+    used += n;
+
+    if (fill==length) {
+        /* a section with the long syntax ends with a crc_32, the crc of the whole section is zero */
+        bool syntax = section[1] & 0x80;
+        if (syntax && (length<12 || crc32_mpeg2(section, length)!=0))
+            crc_errors++;
+        else
+            whole.insert(whole.end(), section, section+length);
+        fill = 0;
+    }
+
+    return used;
+}
+
+void dlsection::add(const unsigned char *packet, const tspacket_t *desc)
+{
+    whole.clear();
+    taken = 0;
+    if (!(desc->flags & TS_FLAG_PAYLOAD) || (desc->flags & TS_FLAG_ERROR))
+        return;
+
+    /* skip a duplicate packet, a discontinuity loses the section being assembled */
+    if (last_cc>=0 && desc->cc==last_cc)
+        return;
+    if (last_cc>=0 && desc->cc!=((last_cc+1) & 0xf))
+        fill = -1;
+    last_cc = desc->cc;
+
+    const unsigned char *data = packet + desc->payload;
+    int bytes = 188 - desc->payload;
+
+    bool pusi = desc->flags & TS_FLAG_PUSI;
+    if (pusi) {
+        /* the pointer_field gives the end of the previous section and the start of the next */
+        int pointer_field = data[0];
+        data++;
+        bytes--;
+        if (pointer_field>bytes) {
+            fill = -1;
+            return;
         }
+        if (fill>0)
+            gather(data, pointer_field);
+        data += pointer_field;
+        bytes -= pointer_field;
+        fill = 0;
+    }
 
-        /* find the pmt_pids */
-        int section_length = (packet[2]<<8 | packet[3]) & 0xfff;
-        int index = 9;
-        while (index<section_length+4-4) { /* +4: packet before section_length, -4: crc_32 */
-            int program_number = (packet[index]<<8) | packet[index+1];
-            if (program_number>0)
-                pmt_pid[num_pmts++] = (packet[index+2]<<8 | packet[index+3]) & 0x1fff;
-            index += 4;
+    while (bytes>0 && fill>=0) {
+        /* the rest of the packet is stuffing */
+        if (fill==0 && data[0]==0xff) {
+            fill = -1;
+            break;
         }
+        int used = gather(data, bytes);
+        data += used;
+        bytes -= used;
 
-    } while (num_pmts==0);
+        /* only a packet with a payload unit start can start another section */
+        if (fill==0 && !pusi)
+            fill = -1;
+    }
+}
 
-    //dlmessage("num_pmts=%d pmt_pid[0]=%d pmt_pid[1]=%d", num_pmts, pmt_pid[0], pmt_pid[1]);
+const unsigned char *dlsection::next(int *length)
+{
+    if (taken+3>whole.size())
+        return NULL;
 
-    /* find the video or audio pid */
-    int pid = 0;
-    int pmt_index = 0;
-    do {
-        /* find the next pmt */
-        size_t read = next_data_packet(packet, pmt_pid[pmt_index], source, token);
-        if (read<=0) {
-            dlmessage("failed to find a pmt in input file \"%s\" (need to specify the pids)", source->name());
-            return 0;
+    const unsigned char *s = &whole[taken];
+    *length = 3 + ((s[1]<<8 | s[2]) & 0xfff);
+    taken += *length;
+    return s;
+}
+
+/* program specific information */
+dlpsi::dlpsi() : sections(8192, (dlsection *)NULL), psi_pid(8192, 0)
+{
+    updates = 0;
+    pat_version = -1;
+    psi_pid[0] = 1;
+}
+
+dlpsi::~dlpsi()
+{
+    for (unsigned i=0; i<sections.size(); i++)
+        delete sections[i];
+}
+
+bool dlpsi::add(const unsigned char *packet, const tspacket_t *desc)
+{
+    int pid = desc->pid;
+    if (!psi_pid[pid] || (desc->flags & TS_FLAG_ERROR))
+        return false;
+    if (sections[pid]==NULL)
+        sections[pid] = new dlsection;
+    dlsection *assembler = sections[pid];
+
+    /* a repeat of a table already read is skipped from the header of its section
+     * until the next payload unit start, without reassembling it or checking its crc */
+    const unsigned char *data = packet + desc->payload;
+    if ((desc->flags & TS_FLAG_PUSI) && (desc->flags & TS_FLAG_PAYLOAD) && data[0]==0 && desc->payload+9<=188) {
+        const unsigned char *section = data + 1;
+        int table_id = section[0];
+        int number = section[3]<<8 | section[4];
+        int version = (section[5] >> 1) & 0x1f;
+        bool repeat = false;
+        if (pid==0 && table_id==0x00)
+            repeat = version==pat_version;
+        else if (table_id==0x02)
+            for (unsigned i=0; i<programs.size(); i++)
+                if (programs[i].pmt_pid==pid && programs[i].number==number)
+                    repeat = version==programs[i].version;
+        if (repeat) {
+            assembler->reset();
+            return false;
         }
+    }
+
+    assembler->add(packet, desc);
+
+    /* parse the whole sections */
+    bool changed = false;
+    int length;
+    const unsigned char *section;
+    while ((section = assembler->next(&length)))
+        if (pid==0 && section[0]==0x00)
+            changed |= parse_pat(section, length);
+        else if (section[0]==0x02)
+            changed |= parse_pmt(section, length);
+
+    return changed;
+}
+
+bool dlpsi::parse_pat(const unsigned char *section, int length)
+{
+    /* ignore a table which is not yet applicable */
+    int version = (section[5] >> 1) & 0x1f;
+    int current_next_indicator = section[5] & 1;
+    if (!current_next_indicator)
+        return false;
+    int section_number = section[6];
+
+    /* a new version replaces the programs, keeping the pmts which are unchanged */
+    if (section_number==0) {
+        if (pat_version>=0 && version!=pat_version) {
+            dlmessage("program association table changed to version %d", version);
+            updates++;
+        }
+        for (unsigned i=0; i<programs.size(); i++)
+            psi_pid[programs[i].pmt_pid] = 0;
+    }
+    std::vector<program_t> previous;
+    if (section_number==0)
+        previous.swap(programs);
+    bool changed = version!=pat_version;
+    pat_version = version;
+
+    /* the programs up to the crc_32 */
+    for (int index=8; index+4<=length-4; index+=4) {
+        int program_number = section[index]<<8 | section[index+1];
+        int pid = (section[index+2]<<8 | section[index+3]) & 0x1fff;
+        if (program_number==0)
+            continue;   /* network pid */
+
+        program_t program;
+        program.number = program_number;
+        program.pmt_pid = pid;
+        program.version = -1;
+        program.pcr_pid = -1;
+        for (unsigned i=0; i<previous.size(); i++)
+            if (previous[i].number==program_number && previous[i].pmt_pid==pid)
+                program = previous[i];
+        programs.push_back(program);
+        psi_pid[pid] = 1;
+    }
+
+    return changed;
+}
 
-        int section_length = (packet[2]<<8 | packet[3]) & 0xfff;
-        if (section_length>1021)
+bool dlpsi::parse_pmt(const unsigned char *section, int length)
+{
+    int program_number = section[3]<<8 | section[4];
+    int version = (section[5] >> 1) & 0x1f;
+    int current_next_indicator = section[5] & 1;
+    if (!current_next_indicator || length<16)
+        return false;
+
+    for (unsigned p=0; p<programs.size(); p++) {
+        program_t *program = &programs[p];
+        if (program->number!=program_number)
             continue;
+        if (program->version==version)
+            return false;
+        if (program->version>=0) {
+            dlmessage("program map table of program %d changed to version %d", program_number, version);
+            updates++;
+        }
+
+        program->version = version;
+        program->pcr_pid = (section[8]<<8 | section[9]) & 0x1fff;
+        program->stream_types.clear();
+        program->pids.clear();
 
         /* skip any descriptors */
-        int program_info_length = (packet[11]<<8 | packet[12]) & 0xfff;
-        if (program_info_length>section_length-9)
-            /* this seems to be a problem in some streams, ignore packet */
-            continue;
-        size_t index = 13 + program_info_length;
-
-        /* find the pid which carries one of the given stream types */
-        while (index<read) {
-            int stream_type = packet[index];
-            int pid = (packet[index+1]<<8 | packet[index+2]) & 0x1fff;
-            int es_info_length = (packet[index+3]<<8 | packet[index+4]) & 0xfff;
-            /* try to match stream type */
-            for (int i=0; i<num_stream_types; i++)
-                if (stream_types[i]==stream_type) {
-                    *found_type = stream_type;
-                    return pid;
-                }
-            /* stream_type==0x02 - mpeg2 video
-             * stream_type==0x80 - user private, assume mpeg2 video
-             * stream_type==0x03 - mpeg1 audio
-             * stream_type==0x04 - mpeg2 audio
-             * stream_type==0x81 - user private, assume ac3 audio
-             * stream_type==0x1b - h.264 video
-             * stream_type==0x24 - hevc video */
+        int program_info_length = (section[10]<<8 | section[11]) & 0xfff;
+        int index = 12 + program_info_length;
+
+        /* the elementary streams up to the crc_32 */
+        while (index+5<=length-4) {
+            program->stream_types.push_back(section[index]);
+            program->pids.push_back((section[index+1]<<8 | section[index+2]) & 0x1fff);
+            int es_info_length = (section[index+3]<<8 | section[index+4]) & 0xfff;
             index += 5 + es_info_length;
         }
+        return true;
+    }
 
-        /* try the next pmt */
-        pmt_index++;
+    return false;
+}
 
-    } while (pid==0 && pmt_index<num_pmts);
+bool dlpsi::complete()
+{
+    if (pat_version<0 || programs.empty())
+        return false;
+    for (unsigned p=0; p<programs.size(); p++)
+        if (programs[p].version<0)
+            return false;
+    return true;
+}
 
-    return 0;
+int dlpsi::streams(int stream_types[], int pids[], int max_streams)
+{
+    int num_streams = 0;
+    for (unsigned p=0; p<programs.size(); p++)
+        for (unsigned s=0; s<programs[p].pids.size() && num_streams<max_streams; s++) {
+            stream_types[num_streams] = programs[p].stream_types[s];
+            pids[num_streams] = programs[p].pids[s];
+            num_streams++;
+        }
+    return num_streams;
+}
+
+int dlpsi::pcr_pid()
+{
+    for (unsigned p=0; p<programs.size(); p++)
+        if (programs[p].version>=0)
+            return programs[p].pcr_pid;
+    return -1;
+}
+
+unsigned long long dlpsi::crc_errors()
+{
+    unsigned long long errors = 0;
+    for (unsigned i=0; i<sections.size(); i++)
+        if (sections[i])
+            errors += sections[i]->crc_errors;
+    return errors;
+}
+
+/* single pass transport stream demultiplexer */
+dltsdemux::dltsdemux(dlsource *s, size_t b)
+{
+    source = s;
+    token = source->attach();
+    blocksize = b;
+    packets.resize(blocksize/188 + 1);
+    memset(map, -1, sizeof(map));
+    current = NULL;
+    carried = 0;
+    pcr_pid = -1;
+}
+
+dltsdemux::~dltsdemux()
+{
+    for (unsigned i=0; i<streams.size(); i++) {
+        stream_t *s = streams[i];
+        if (s->assembling)
+            s->spare.push_back(s->assembling);
+        if (s->reading)
+            s->spare.push_back(s->reading);
+        for (unsigned j=0; j<s->queue.size(); j++)
+            s->spare.push_back(s->queue[j]);
+        for (unsigned j=0; j<s->spare.size(); j++)
+            delete s->spare[j];
+        free(s->gathered);
+        delete s;
+    }
+    for (unsigned i=0; i<blocks.size(); i++) {
+        free(blocks[i]->data);
+        delete blocks[i];
+    }
+}
+
+void dltsdemux::add_pid(int pid)
+{
+    if (map[pid]>=0)
+        return;
+    if (streams.size()>=127)
+        dlexit("too many pids to demultiplex");
+
+    stream_t *s = new stream_t;
+    s->pid = pid;
+    s->assembling = s->reading = NULL;
+    s->discarded = 0;
+    s->gathered = NULL;
+    s->alloc = 0;
+    map[pid] = streams.size();
+    streams.push_back(s);
+}
+
+/* a block for reading the source into, with the reference of the reader */
+dltsdemux::block_t *dltsdemux::get_block()
+{
+    block_t *block;
+    if (free_blocks.empty()) {
+        block = new block_t;
+        block->data = (unsigned char *) malloc(blocksize);
+        blocks.push_back(block);
+    } else {
+        block = free_blocks.back();
+        free_blocks.pop_back();
+    }
+    block->refs = 1;
+    return block;
+}
+
+void dltsdemux::release(block_t *block)
+{
+    if (--block->refs==0)
+        free_blocks.push_back(block);
+}
+
+/* hand back a pes packet for reuse, and its blocks once no other pes packet holds them */
+void dltsdemux::recycle(stream_t *s, pes_t *pes)
+{
+    for (unsigned i=0; i<pes->blocks.size(); i++)
+        release(pes->blocks[i]);
+    pes->blocks.clear();
+    pes->spans.clear();
+    s->spare.push_back(pes);
+}
+
+/* queue the pes packet being assembled, it is whole */
+void dltsdemux::finish(stream_t *s)
+{
+    if (s->assembling==NULL)
+        return;
+    if (s->assembling->size==0) {
+        recycle(s, s->assembling);
+        s->assembling = NULL;
+        return;
+    }
+
+    /* bound the memory held for a pid which is not being read */
+    if (s->queue.size()>=TS_MAX_QUEUED) {
+        if (s->discarded++==0)
+            dlmessage("warning: pes packets of pid %d are not being read, discarding the oldest", s->pid);
+        recycle(s, s->queue.front());
+        s->queue.pop_front();
+    }
+    s->queue.push_back(s->assembling);
+    s->assembling = NULL;
+}
+
+/* add a transport packet to the pes packet of its pid */
+void dltsdemux::dispatch(const unsigned char *p, const tspacket_t *d)
+{
+    /* keep the program map up to date */
+    if (psi.carries(d->pid) && psi.add(p, d))
+        pcr_pid = psi.pcr_pid();
+
+    /* sample the program clock as the packet arrived */
+    if (d->pid==pcr_pid && (d->flags & TS_FLAG_ADAPTATION)) {
+        long long pcr = packet_pcr(p, d);
+        unsigned long long arrival = source->arrival();
+        if (pcr>=0 && arrival) {
+            if (pcrs.size()>=TS_MAX_PCRS)
+                pcrs.pop_front();
+            pcr_t sample = {pcr, arrival};
+            pcrs.push_back(sample);
+        }
+    }
+
+    if (map[d->pid]<0 || (d->flags & TS_FLAG_ERROR))
+        return;
+    stream_t *s = streams[map[d->pid]];
+
+    /* check start indicator */
+    int payload_unit_start_indicator = d->flags & TS_FLAG_PUSI;
+    if (payload_unit_start_indicator) {
+        /* start of next pes packet i.e. end of this one */
+        finish(s);
+        if (s->spare.empty())
+            s->spare.push_back(new pes_t);
+        s->assembling = s->spare.back();
+        s->spare.pop_back();
+        s->assembling->size = 0;
+        s->assembling->pts = s->assembling->dts = -1ll;
+    } else if (s->assembling==NULL)
+        return;     /* looking for start of next pes packet */
+    pes_t *pes = s->assembling;
+
+    /* skip transport packet header and adaptation field */
+    int ptr = d->payload;
+    if (!(d->flags & TS_FLAG_PAYLOAD))
+        return;
+
+    /* skip pes header */
+    if (payload_unit_start_indicator && ptr+9<=188) {
+        int packet_start_code_prefix = (p[ptr]<<16) | (p[ptr+1]<<8) | p[ptr+2];
+        int stream_id = p[ptr+3];
+        if (packet_start_code_prefix!=0x1)
+            dlexit("error parsing pes header, start_code=0x%06x stream_id=0x%02x", packet_start_code_prefix, stream_id);
+
+        /* look for pts and dts */
+        int pts_dts_flags = p[ptr+7] >> 6;
+        if (pts_dts_flags==2 || pts_dts_flags==3) {
+            long long pts3 = (p[ptr+9] >> 1) & 0x7;
+            long long pts2 = (p[ptr+10] << 7 | (p[ptr+11] >> 1));
+            long long pts1 = (p[ptr+12] << 7 | (p[ptr+13] >> 1));
+            pes->pts = (pts3<<30) | (pts2<<15) | pts1;
+        }
+        if (pts_dts_flags==3) {
+            long long dts3 = (p[ptr+14] >> 1) & 0x7;
+            long long dts2 = (p[ptr+15] << 7 | (p[ptr+16] >> 1));
+            long long dts1 = (p[ptr+17] << 7 | (p[ptr+18] >> 1));
+            pes->dts = (dts3<<30) | (dts2<<15) | dts1;
+        }
+
+        int pes_header_data_length = p[ptr+8];
+
+        ptr += 9 + pes_header_data_length;
+    }
+    if (ptr>=188)
+        return;
+
+    /* hold the block for the payload */
+    if (current && (pes->blocks.empty() || pes->blocks.back()!=current)) {
+        current->refs++;
+        pes->blocks.push_back(current);
+    }
+
+    span_t span = {p+ptr, (size_t)(188-ptr)};
+    pes->spans.push_back(span);
+    pes->size += 188-ptr;
+}
+
+/* read and dispatch the next block of the source, returns false at the end of the stream */
+bool dltsdemux::fill()
+{
+    const unsigned char *data;
+    size_t bytes;
+    block_t *block = NULL;
+    if (source->retains() && !carried) {
+        /* zero copy read of a block which stays valid */
+        bytes = blocksize;
+        data = source->read(&bytes, token);
+        if (data==NULL || bytes==0 || bytes==(size_t)-1)
+            return false;
+    } else {
+        /* read into a block of our own, after the start of a packet split across reads,
+         * just completing the packet of a source which retains its data */
+        block = get_block();
+        memcpy(block->data, partial, carried);
+        size_t ret = source->read(block->data+carried, source->retains()? 188-carried : blocksize-carried, token);
+        if (ret==0 || ret==(size_t)-1) {
+            release(block);
+            return false;
+        }
+        data = block->data;
+        bytes = carried + ret;
+        carried = 0;
+    }
+
+    /* describe the packets then dispatch them */
+    current = block;
+    size_t consumed;
+    int n = parse_packets(data, bytes, &packets[0], packets.size(), &consumed);
+    for (int i=0; i<n; i++)
+        dispatch(data+packets[i].offset, &packets[i]);
+    current = NULL;
+    if (block)
+        release(block);
+
+    /* keep the start of a packet which continues in the next block */
+    if (consumed<bytes) {
+        carried = bytes - consumed;
+        memcpy(partial, data+consumed, carried);
+    }
+
+    return true;
+}
+
+const span_t *dltsdemux::read_spans(int pid, int *count, size_t *bytes, long long *pts, long long *dts)
+{
+    add_pid(pid);
+    stream_t *s = streams[map[pid]];
+
+    /* finished with the last pes packet */
+    if (s->reading) {
+        recycle(s, s->reading);
+        s->reading = NULL;
+    }
+
+    /* read until a whole pes packet of the pid is queued */
+    while (s->queue.empty())
+        if (!fill()) {
+            /* at the end of the stream the pes packets being assembled are whole */
+            for (unsigned i=0; i<streams.size(); i++)
+                finish(streams[i]);
+            if (s->queue.empty()) {
+                *count = 0;
+                *bytes = 0;
+                return NULL;
+            }
+        }
+
+    s->reading = s->queue.front();
+    s->queue.pop_front();
+    *count = s->reading->spans.size();
+    *bytes = s->reading->size;
+    *pts = s->reading->pts;
+    *dts = s->reading->dts;
+    return &s->reading->spans[0];
+}
+
+const unsigned char *dltsdemux::read(int pid, size_t *bytes, long long *pts, long long *dts)
+{
+    int count;
+    const span_t *spans = read_spans(pid, &count, bytes, pts, dts);
+    if (spans==NULL)
+        return NULL;
+    if (count==1)
+        return spans[0].data;
+
+    /* gather the spans, the buffer only grows to the largest pes packet */
+    stream_t *s = streams[map[pid]];
+    if (*bytes>s->alloc) {
+        s->alloc = mmax(mmax(*bytes, 2*s->alloc), (size_t)64*1024);
+        free(s->gathered);
+        s->gathered = (unsigned char *) malloc(s->alloc);
+    }
+    unsigned char *p = s->gathered;
+    for (int i=0; i<count; i++) {
+        memcpy(p, spans[i].data, spans[i].size);
+        p += spans[i].size;
+    }
+    return s->gathered;
+}
+
+bool dltsdemux::next_pcr(long long *pcr, unsigned long long *arrival)
+{
+    if (pcrs.empty())
+        return false;
+
+    *pcr = pcrs.front().pcr;
+    *arrival = pcrs.front().arrival;
+    pcrs.pop_front();
+    return true;
+}
+
+int dltsdemux::rewind()
+{
+    /* discard the partial pes packets, whole ones can still be read */
+    carried = 0;
+    pcrs.clear();
+    for (unsigned i=0; i<streams.size(); i++) {
+        stream_t *s = streams[i];
+        if (s->assembling) {
+            recycle(s, s->assembling);
+            s->assembling = NULL;
+        }
+    }
+
+    return source->rewind(token);
+}
+
+bool dltsdemux::eof(int pid)
+{
+    /* at the end when the source is and all of the pes packets of the pid have been read */
+    if (map[pid]>=0) {
+        stream_t *s = streams[map[pid]];
+        if (!s->queue.empty() || s->assembling)
+            return false;
+    }
+    return source->eof(token);
 }
@@ -1,13 +1,222 @@
 #ifndef DLTS_H
 #define DLTS_H
 
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
 #include "dlutil.h"
 #include "dlsource.h"
 
+/* most elementary streams read from the program maps of a transport stream */
+#define TS_MAX_STREAMS 64
+
+/* size of the blocks read by the demultiplexer from a file, and the most whole pes packets
+ * queued for a pid which is not being read before the oldest is discarded */
+#define TS_BLOCKSIZE (256*188)
+#define TS_MAX_QUEUED 1024
+
+/* most program clock references kept for clock recovery before the oldest is discarded */
+#define TS_MAX_PCRS 256
+
+/* flags of a transport packet descriptor */
+#define TS_FLAG_PUSI        0x01    /* payload unit start indicator */
+#define TS_FLAG_PAYLOAD     0x02
+#define TS_FLAG_ADAPTATION  0x04
+#define TS_FLAG_ERROR       0x08    /* transport error indicator */
+
+/* descriptor of a transport packet in a block */
+typedef struct {
+    uint32_t offset;        /* of the packet in the block */
+    uint16_t pid;
+    uint8_t flags;
+    uint8_t payload;        /* offset of the payload in the packet, 188 if there is none */
+    uint8_t cc;             /* continuity counter */
+} tspacket_t;
+
+uint32_t crc32_mpeg2(const unsigned char *data, size_t bytes);
+int parse_packets(const unsigned char *block, size_t bytes, tspacket_t *packets, int max_packets, size_t *consumed);
+long long packet_pcr(const unsigned char *packet, const tspacket_t *desc);
+const unsigned char *next_packet_ptr(unsigned char *scratch, dlsource *source, dltoken_t token);
 int next_packet(unsigned char *packet, dlsource *source, dltoken_t token);
 int next_data_packet(unsigned char *data, int pid, dlsource *source, dltoken_t token);
 int next_stream_packet(unsigned char *data, int vid_pid, int aud_pid, int *pid, dlsource *source, dltoken_t token);
 int next_pes_packet_data(unsigned char *data, long long *pts, long long *dts, int pid, int start, dlsource *source, dltoken_t token);
+int find_program_streams(int stream_types[], int pids[], int max_streams, dlsource *source, dltoken_t token);
+int find_pid_in_program(int stream_types[], int num_stream_types, int *found_type, const int program_types[], const int program_pids[], int num_streams);
 int find_pid_for_stream_type(int stream_types[], int num_stream_types, int *found_type, dlsource *source, dltoken_t token);
 
+/* largest psi section, a private section */
+#define TS_MAX_SECTION 4096
+
+/* section assembler class, the sections of one pid are reassembled from the payloads of its packets */
+class dlsection
+{
+public:
+    dlsection();
+
+    /* add a packet of the pid, sections with a bad crc are discarded */
+    void add(const unsigned char *packet, const tspacket_t *desc);
+    /* wait for the next payload unit start */
+    void reset() { fill = -1; }
+
+    /* the sections completed by the last packet added in turn, null when there are no more */
+    const unsigned char *next(int *length);
+
+    unsigned long long crc_errors;
+
+private:
+    int gather(const unsigned char *data, int bytes);
+
+    /* section being assembled, fill is -1 until the start of a section */
+    unsigned char section[TS_MAX_SECTION];
+    int fill;
+    int last_cc;
+
+    /* whole sections back to back */
+    std::vector<unsigned char> whole;
+    size_t taken;
+};
+
+/* program specific information class, the program map of a transport stream is built from the
+ * pat and pmt sections and kept up to date as they repeat, a repeat of a table already read is
+ * recognised from its version and skipped without reassembling or parsing it */
+class dlpsi
+{
+public:
+    dlpsi();
+    ~dlpsi();
+
+    /* add a transport packet, returns true if the program map has changed */
+    bool add(const unsigned char *packet, const tspacket_t *desc);
+    /* the pid carries the pat or a pmt */
+    bool carries(int pid) { return psi_pid[pid]; }
+
+    /* the pat and the pmts of all of its programs have been read */
+    bool has_pat() { return pat_version>=0; }
+    bool complete();
+
+    /* the elementary streams of all programs in order, and the pcr pid of the first program */
+    int streams(int stream_types[], int pids[], int max_streams);
+    int pcr_pid();
+
+    /* number of tables read again with a new version, and of sections discarded with a bad crc */
+    unsigned updates;
+    unsigned long long crc_errors();
+
+private:
+    bool parse_pat(const unsigned char *section, int length);
+    bool parse_pmt(const unsigned char *section, int length);
+
+    /* a program of the pat and its pmt */
+    typedef struct {
+        int number;
+        int pmt_pid;
+        int version;            /* of the pmt, -1 until it is read */
+        int pcr_pid;
+        std::vector<int> stream_types;
+        std::vector<int> pids;
+    } program_t;
+
+    int pat_version;
+    std::vector<program_t> programs;
+
+    /* section assemblers of the psi pids */
+    std::vector<dlsection *> sections;
+    std::vector<char> psi_pid;
+};
+
+/* single pass transport stream demultiplexer, one reader of the source pulls large blocks
+ * and dispatches the packets of each registered pid into a queue of whole pes packets,
+ * so several formats can read their own pid without reading the stream again, the payload
+ * of a pes packet is not copied but kept as a list of spans in the blocks, which are
+ * reference counted by the pes packets unless the source retains its data */
+class dltsdemux
+{
+public:
+    dltsdemux(dlsource *source, size_t blocksize=TS_BLOCKSIZE);
+    ~dltsdemux();
+
+    /* demultiplex a pid, the packets of other pids are discarded */
+    void add_pid(int pid);
+
+    /* the next whole pes packet of a pid as the spans of its payload, valid until the next read
+     * of the pid, null at the end of the stream */
+    const span_t *read_spans(int pid, int *count, size_t *bytes, long long *pts, long long *dts);
+    /* the same gathered into one buffer, for decoders which need contiguous data */
+    const unsigned char *read(int pid, size_t *bytes, long long *pts, long long *dts);
+    int rewind();
+    bool eof(int pid);
+
+    /* the next program clock reference of the program in 27MHz units, with its time of arrival
+     * in usecs, from a live source which knows when its data arrived */
+    bool next_pcr(long long *pcr, unsigned long long *arrival);
+
+    /* the source is read with a single token */
+    dlsource *source;
+    dltoken_t token;
+
+    /* program map, kept up to date from the psi of the stream */
+    dlpsi psi;
+
+private:
+    /* a block read from the source */
+    typedef struct {
+        unsigned char *data;
+        unsigned refs;
+    } block_t;
+
+    /* a pes packet, its payload in the blocks it holds a reference to */
+    typedef struct {
+        std::vector<span_t> spans;
+        std::vector<block_t *> blocks;
+        size_t size;
+        long long pts, dts;
+    } pes_t;
+
+    /* a demultiplexed pid */
+    typedef struct {
+        int pid;
+        pes_t *assembling;          /* pes packet being assembled, null until a payload unit start */
+        pes_t *reading;             /* pes packet returned by the last read */
+        std::deque<pes_t *> queue;  /* whole pes packets waiting to be read */
+        std::vector<pes_t *> spare; /* buffers for reuse */
+        unsigned long long discarded;
+        unsigned char *gathered;    /* contiguous copy of the pes packet being read */
+        size_t alloc;
+    } stream_t;
+
+    bool fill();
+    void dispatch(const unsigned char *packet, const tspacket_t *desc);
+    void finish(stream_t *s);
+    void recycle(stream_t *s, pes_t *pes);
+    block_t *get_block();
+    void release(block_t *block);
+
+    size_t blocksize;
+    signed char map[8192];      /* index of the stream of each pid, -1 if not demultiplexed */
+    std::vector<stream_t *> streams;
+
+    /* descriptors of the packets of a block */
+    std::vector<tspacket_t> packets;
+
+    /* the block being dispatched, null if the source retains its data, and blocks for reuse */
+    block_t *current;
+    std::vector<block_t *> blocks;
+    std::vector<block_t *> free_blocks;
+
+    /* a packet split across reads of the source */
+    unsigned char partial[188];
+    int carried;
+
+    /* program clock references waiting to be taken */
+    typedef struct {
+        long long pcr;
+        unsigned long long arrival;
+    } pcr_t;
+    int pcr_pid;
+    std::deque<pcr_t> pcrs;
+};
+
 #endif
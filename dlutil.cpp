@@ -180,7 +180,10 @@ const char *pixelformatname[] = {
     "I444",
     "UYVY",
     "YU15",
-    "YU20"
+    "YU20",
+    "V210",
+    "P010",
+    "P210"
 };
 
 int divine_pixel_format(const char *filename, pixelformat_t *pixelformat)
@@ -191,9 +194,13 @@ int divine_pixel_format(const char *filename, pixelformat_t *pixelformat)
     if (strstr(filename, "uyvy")!=NULL || strstr(filename, "UYVY")!=NULL)
         *pixelformat = UYVY;
     else if (strstr(filename, "yu15")!=NULL || strstr(filename, "YU15")!=NULL)
-        *pixelformat = YU20;
+        *pixelformat = YU15;
     else if (strstr(filename, "yu20")!=NULL || strstr(filename, "YU20")!=NULL)
         *pixelformat = YU20;
+    else if (strstr(filename, "p010")!=NULL || strstr(filename, "P010")!=NULL)
+        *pixelformat = P010;
+    else if (strstr(filename, "p210")!=NULL || strstr(filename, "P210")!=NULL)
+        *pixelformat = P210;
     else if (strstr(filename, "444")!=NULL)
         *pixelformat = I444;
     else if (strstr(filename, "422")!=NULL)
@@ -374,6 +381,9 @@ size_t pixelformat_get_size(pixelformat_t pixelformat, int width, int height)
         case I444: return width*height*3;
         case YU15: return 2*width*height + 4*width*height/4;
         case YU20: return 2*width*height + 4*width*height/2;
+        case V210: return ((width+47)/48)*128*height;
+        case P010: return 2*width*height + 2*width*height/2;
+        case P210: return 2*width*height + 2*width*height;
         case UNKNOWN: dlexit("unknown pixelformat: %d", pixelformat);
     }
     return 0;
@@ -381,7 +391,7 @@ size_t pixelformat_get_size(pixelformat_t pixelformat, int width, int height)
 
 bool pixelformat_is_8bit(pixelformat_t pixelformat)
 {
-    if (pixelformat==YU15 || pixelformat==YU20)
+    if (pixelformat==YU15 || pixelformat==YU20 || pixelformat==V210 || pixelformat==P010 || pixelformat==P210)
         return 0;
     return 1;
 }
@@ -27,7 +27,10 @@ typedef enum {
     I444,
     UYVY,
     YU15,
-    YU20
+    YU20,
+    V210,
+    P010,
+    P210
 } pixelformat_t;
 
 /* timestamp */